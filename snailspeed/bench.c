@@ -0,0 +1,286 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+// Microbenchmarks for the 64x64 block kernels and their load/store paths.
+//
+// Every kernel runs on its own, on L1-resident blocks unless the benchmark is
+// about the stride, and reports TSC cycles and nanoseconds per block of the
+// best of several trials as CSV (or JSON with -j) for comparing builds
+
+#include "../utils/pool.h"
+#include "../utils/utils.h"
+#include "../utils/fasttime.h"
+#include "my_utils.h"
+#include <string.h>
+#include <unistd.h>
+
+#define NTRIALS 7
+#define DEFAULT_ITERATIONS 20000
+
+struct bench_s {
+  uint64_t *img;
+  uint64_t *mask;
+  bytes_t row_size;
+  bits_t N;
+  uint64_t block[64];
+  uint64_t rotated[64];
+  struct block_post_s post;
+
+  // The next cycle of the cycle benchmarks, which walk the whole matrix in
+  // the order of the rotation so that its size sets the working set
+  struct tile_cursor_s cursor;
+  uint32_t wide_i, wide_j;
+};
+
+typedef void (*bench_fn_t)(struct bench_s *b, uint32_t iters);
+
+// Keeps the compiler from optimizing the benchmarked work away
+static volatile uint64_t sink;
+
+static bool json = false;
+static bool first_record = true;
+
+static void bench_rcr(struct bench_s *b, uint32_t iters) {
+  for (uint32_t it = 0; it < iters; it++) {
+    rotate_block_64(b->block, b->rotated);
+  }
+  sink = b->rotated[0];
+}
+
+static void bench_rotate_and_set(struct bench_s *b, uint32_t iters) {
+  for (uint32_t it = 0; it < iters; it++) {
+    rotate_and_set_block_64(b->img, b->row_size, 0, 0, b->block);
+  }
+  sink = b->img[0];
+}
+
+static void bench_rotate_and_set_post(struct bench_s *b, uint32_t iters) {
+  for (uint32_t it = 0; it < iters; it++) {
+    rotate_and_set_block_64_post(b->img, b->row_size, 0, 0, b->block, &b->post);
+  }
+  sink = b->img[0];
+}
+
+static void bench_gather(struct bench_s *b, uint32_t iters) {
+  for (uint32_t it = 0; it < iters; it++) {
+    get_block_64(b->img, b->row_size, 0, 0, b->block);
+    sink = b->block[it % 64];
+  }
+}
+
+static void bench_scatter(struct bench_s *b, uint32_t iters) {
+  for (uint32_t it = 0; it < iters; it++) {
+    b->rotated[it % 64] = it;
+    store_rotated_block_64(b->img, b->row_size, 0, 0, b->rotated);
+  }
+  sink = b->img[0];
+}
+
+// The 4-block cycle, at every cycle of the tile schedule of the rotation in
+// turn, starting over once the matrix is done
+static void bench_cycle(struct bench_s *b, uint32_t iters) {
+  uint64_t save_block[64];
+  uint32_t i, j;
+  for (uint32_t it = 0; it < iters; it++) {
+    if (!tile_cursor_next(&b->cursor, &i, &j)) {
+      tile_cursor_init(&b->cursor, b->N);
+      tile_cursor_next(&b->cursor, &i, &j);
+    }
+    rotate_cycle_64(b->img, b->row_size, b->N, i, j, b->block, save_block, NULL);
+  }
+  sink = b->img[0];
+}
+
+// The 4-block cycle in wide blocks, whose blocks are 4 or 16 of 64x64, over
+// the wide blocks of the top-left quadrant row by row, starting over once
+// the quadrant is done
+static void bench_cycle_wide(struct bench_s *b, uint32_t iters, const uint32_t width) {
+  uint64_t tmp_block[16 * 64], save_block[16 * 64];
+  const uint32_t bound = b->N / 2 / width * width;
+  assert(bound >= width);
+  for (uint32_t it = 0; it < iters; it++) {
+    rotate_cycle_wide(b->img, b->row_size, b->N, b->wide_i, b->wide_j, tmp_block, save_block, NULL,
+                      width);
+    b->wide_i += width;
+    if (b->wide_i >= bound) {
+      b->wide_i = 0;
+      b->wide_j = b->wide_j + width >= bound ? 0 : b->wide_j + width;
+    }
+  }
+  sink = b->img[0];
+}
+
+static void bench_cycle_128(struct bench_s *b, uint32_t iters) {
+  bench_cycle_wide(b, iters, 128);
+}
+
+static void bench_cycle_256(struct bench_s *b, uint32_t iters) {
+  bench_cycle_wide(b, iters, 256);
+}
+
+// Prints one measurement
+static void print_record(const char *bench, const char *variant, bytes_t row_size, double cycles, double ns) {
+  if (json) {
+    printf("%s  {\"bench\": \"%s\", \"variant\": \"%s\", \"row_size\": %zu, "
+           "\"cycles_per_block\": %.2f, \"ns_per_block\": %.3f}",
+           first_record ? "" : ",\n", bench, variant, row_size, cycles, ns);
+  } else {
+    printf("%s,%s,%zu,%.2f,%.3f\n", bench, variant, row_size, cycles, ns);
+  }
+  first_record = false;
+}
+
+// Runs `fn` for `iters` iterations of `blocks_per_iter` blocks each, `NTRIALS`
+// times, and prints the best trial per block
+static void run(const char *bench, const char *variant, bench_fn_t fn, struct bench_s *b, uint32_t iters,
+                uint32_t blocks_per_iter) {
+  double best_cycles = 1e300, best_ns = 1e300;
+
+  // warm up the caches and the branch predictors
+  fn(b, iters / 10 + 1);
+
+  for (int t = 0; t < NTRIALS; t++) {
+    const uint64_t start_cycles = getcycles();
+    const fasttime_t start = gettime();
+    fn(b, iters);
+    const fasttime_t stop = gettime();
+    const uint64_t stop_cycles = getcycles();
+
+    const double nblocks = (double) iters * blocks_per_iter;
+    const double cycles = (stop_cycles - start_cycles) / nblocks;
+    const double ns = tdiff_nsec(start, stop) / nblocks;
+    best_cycles = cycles < best_cycles ? cycles : best_cycles;
+    best_ns = ns < best_ns ? ns : best_ns;
+  }
+
+  print_record(bench, variant, b->row_size, best_cycles, best_ns);
+}
+
+// Allocates a matrix of 64 rows of `row_size` words for the stride benchmarks
+static void setup_rows(struct bench_s *b, bytes_t row_size) {
+  matrix_free((uint8_t *) b->img);
+  b->row_size = row_size;
+  b->N = row_size * 64;
+  b->img = (uint64_t *) matrix_alloc(64 * row_size * sizeof(uint64_t));
+  assert(b->img);
+  memset(b->img, 0x5A, 64 * row_size * sizeof(uint64_t));
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t iters = DEFAULT_ITERATIONS;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "hji:")) != -1) {
+    switch (opt) {
+      case 'j':
+        json = true;
+        break;
+      case 'i':
+        iters = atoi(optarg);
+        if (iters == 0) {
+          goto help;
+        }
+        break;
+      default:
+        goto help;
+    }
+  }
+
+  struct bench_s b = {0};
+  for (int r = 0; r < 64; r++) {
+    b.block[r] = 0x9E3779B97F4A7C15ULL * (r + 1);
+  }
+
+  if (json) {
+    printf("[\n");
+  } else {
+    printf("bench,variant,row_size,cycles_per_block,ns_per_block\n");
+  }
+
+  // Kernels on a single L1-resident block
+  setup_rows(&b, 1);
+  b.mask = aligned_alloc(64, 64 * sizeof(uint64_t));
+  memset(b.mask, 0xC3, 64 * sizeof(uint64_t));
+
+  run("kernel", "rcr", bench_rcr, &b, iters, 1);
+  run("kernel", "rotate_and_set", bench_rotate_and_set, &b, iters, 1);
+
+  const char *op_names[] = {"none", "invert", "xor", "or", "and"};
+  for (int op = BLOCK_OP_NONE; op <= BLOCK_OP_AND; op++) {
+    char variant[64];
+    snprintf(variant, sizeof(variant), "post_%s", op_names[op]);
+    b.post = (struct block_post_s) {.op = op, .mask = b.mask};
+    run("kernel", variant, bench_rotate_and_set_post, &b, iters, 1);
+  }
+
+  // Gather and scatter, one block per iteration, at growing row strides. The
+  // strides just past the powers of two show the cost of set aliasing
+  for (bytes_t row_size = 1; row_size <= 8192; row_size *= 2) {
+    bytes_t strides[2] = {row_size, row_size + 8};
+    for (int s = 0; s < (row_size >= 64 ? 2 : 1); s++) {
+      setup_rows(&b, strides[s]);
+      run("gather", "get_block_64", bench_gather, &b, iters, 1);
+      run("scatter", "store_rotated_block_64", bench_scatter, &b, iters, 1);
+    }
+  }
+
+  // The 4-block cycle, in matrices from L1 up to well past the LLC
+  for (bits_t N = 128; N <= 16384; N *= 2) {
+    matrix_free((uint8_t *) b.img);
+    b.N = N;
+    b.row_size = N / 64;
+    b.img = (uint64_t *) generate_bit_matrix(N, false);
+    assert(b.img);
+    tile_cursor_init(&b.cursor, N);
+    b.wide_i = b.wide_j = 0;
+    run("cycle", "rotate_cycle_64", bench_cycle, &b, iters / 4 + 1, 4);
+
+    // A wide cycle needs a whole wide block in the top-left quadrant
+    if (N >= 256) {
+      run("cycle", "rotate_cycle_128", bench_cycle_128, &b, iters / 16 + 1, 16);
+    }
+    if (N >= 512) {
+      run("cycle", "rotate_cycle_256", bench_cycle_256, &b, iters / 64 + 1, 64);
+    }
+  }
+
+  if (json) {
+    printf("\n]\n");
+  }
+
+  matrix_free((uint8_t *) b.img);
+  free(b.mask);
+  return 0;
+
+help:
+  printf(
+      "usage:\n"
+      "\t"
+      "-j              \t Print JSON instead of CSV\n"
+      "\t"
+      "-i iterations   \t Iterations per trial. Default is %d.\n"
+      "\t"
+      "-h              \t This help message\n",
+      DEFAULT_ITERATIONS);
+  return 1;
+}
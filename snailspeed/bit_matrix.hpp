@@ -0,0 +1,316 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+
+// A header-only C++17 interface to the bit matrices of librotate.h, for
+// callers that want the rotation inlined into their own code rather than
+// called through a function pointer.
+//
+// `BitMatrix<N>` owns an N by N bit matrix, laid out like the matrices of
+// librotate.h, in 64-byte aligned storage. It is move-only: copies are made
+// with `clone()`. `BitMatrix<>` takes its size at run time. With a
+// compile-time N the tile loops have constant bounds, so small matrices
+// unroll completely.
+//
+// `rotate<W>()` rotates in W by W bit blocks, W = 32, 64 or 128, moved in
+// 4-cycles like rotate_bit_matrix() and rotated by a flip and a recursive
+// transpose with masks computed at compile time. 128-bit blocks need
+// unsigned __int128
+
+#ifndef BIT_MATRIX_HPP
+#define BIT_MATRIX_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+namespace librotate {
+
+namespace detail {
+
+// The unsigned word that holds a row of a W by W bit block
+template <std::size_t W>
+struct BlockWord;
+
+template <>
+struct BlockWord<32> {
+  using type = std::uint32_t;
+};
+
+template <>
+struct BlockWord<64> {
+  using type = std::uint64_t;
+};
+
+#ifdef __SIZEOF_INT128__
+template <>
+struct BlockWord<128> {
+  using type = unsigned __int128;
+};
+#endif
+
+template <std::size_t W>
+using block_word_t = typename BlockWord<W>::type;
+
+// Reads a big-endian word: the first byte holds the leftmost 8 bits
+template <std::size_t W>
+inline block_word_t<W> load_row(const std::uint8_t *p) {
+  if constexpr (W == 32) {
+    std::uint32_t x;
+    std::memcpy(&x, p, 4);
+    return __builtin_bswap32(x);
+  } else if constexpr (W == 64) {
+    std::uint64_t x;
+    std::memcpy(&x, p, 8);
+    return __builtin_bswap64(x);
+  } else {
+    std::uint64_t x[2];
+    std::memcpy(x, p, 16);
+    return (block_word_t<W>(__builtin_bswap64(x[0])) << 64) |
+           __builtin_bswap64(x[1]);
+  }
+}
+
+template <std::size_t W>
+inline void store_row(std::uint8_t *p, const block_word_t<W> row) {
+  if constexpr (W == 32) {
+    const std::uint32_t y = __builtin_bswap32(row);
+    std::memcpy(p, &y, 4);
+  } else if constexpr (W == 64) {
+    const std::uint64_t y = __builtin_bswap64(row);
+    std::memcpy(p, &y, 8);
+  } else {
+    const std::uint64_t y[2] = {
+        __builtin_bswap64(static_cast<std::uint64_t>(row >> 64)),
+        __builtin_bswap64(static_cast<std::uint64_t>(row))};
+    std::memcpy(p, y, 16);
+  }
+}
+
+constexpr std::size_t log2(const std::size_t x) {
+  return x <= 1 ? 0 : 1 + log2(x / 2);
+}
+
+// The masks of the transpose: step s swaps the j = W >> (s + 1) bit
+// sub-blocks, and its mask selects the bits whose position has bit j clear.
+// Column 0 is the most significant bit, so those are the columns with bit j
+// set
+template <std::size_t W>
+constexpr std::array<block_word_t<W>, log2(W)> transpose_masks() {
+  std::array<block_word_t<W>, log2(W)> masks{};
+  for (std::size_t s = 0; s < log2(W); s++) {
+    const std::size_t j = W >> (s + 1);
+    block_word_t<W> m = 0;
+    for (std::size_t pos = 0; pos < W; pos++) {
+      if (!(pos & j)) {
+        m |= block_word_t<W>(1) << pos;
+      }
+    }
+    masks[s] = m;
+  }
+  return masks;
+}
+
+// Transposes the W by W bit block `a` in place, from Hacker's Delight, 7-3
+template <std::size_t W>
+inline void transpose_block(block_word_t<W> (&a)[W]) {
+  constexpr auto masks = transpose_masks<W>();
+  for (std::size_t s = 0; s < log2(W); s++) {
+    const std::size_t j = W >> (s + 1);
+    for (std::size_t k = 0; k < W; k = (k + j + 1) & ~j) {
+      const block_word_t<W> t = (a[k] ^ (a[k + j] >> j)) & masks[s];
+      a[k] ^= t;
+      a[k + j] ^= t << j;
+    }
+  }
+}
+
+// Loads the W by W block in block row `r` and block column `c`, upside down,
+// and transposes it: this rotates it clockwise
+template <std::size_t W>
+inline void load_rotated(const std::uint8_t *data, const std::size_t row_bytes,
+                         const std::size_t r, const std::size_t c,
+                         block_word_t<W> (&block)[W]) {
+  const std::uint8_t *p = data + r * W * row_bytes + c * (W / 8);
+  for (std::size_t y = 0; y < W; y++) {
+    block[W - 1 - y] = load_row<W>(p + y * row_bytes);
+  }
+  transpose_block<W>(block);
+}
+
+template <std::size_t W>
+inline void store_block(std::uint8_t *data, const std::size_t row_bytes,
+                        const std::size_t r, const std::size_t c,
+                        const block_word_t<W> (&block)[W]) {
+  std::uint8_t *p = data + r * W * row_bytes + c * (W / 8);
+  for (std::size_t y = 0; y < W; y++) {
+    store_row<W>(p + y * row_bytes, block[y]);
+  }
+}
+
+// Rotates the `n` by `n` bit matrix `data` clockwise in W by W blocks.
+// Block (r, c) moves to (c, nblocks - 1 - r), and the blocks of the top-left
+// quadrant start the 4-cycles. With an odd number of blocks, the quadrant
+// is a column wider and the middle block rotates alone
+template <std::size_t W>
+inline void rotate_blocks(std::uint8_t *data, const std::size_t n) {
+  const std::size_t row_bytes = n / 8;
+  const std::size_t nblocks = n / W;
+  const std::size_t last = nblocks - 1;
+  block_word_t<W> t0[W], t1[W];
+
+  if (nblocks % 2) {
+    load_rotated<W>(data, row_bytes, nblocks / 2, nblocks / 2, t0);
+    store_block<W>(data, row_bytes, nblocks / 2, nblocks / 2, t0);
+  }
+
+  for (std::size_t r = 0; r < nblocks / 2; r++) {
+    for (std::size_t c = 0; c < (nblocks + 1) / 2; c++) {
+      load_rotated<W>(data, row_bytes, r, c, t0);
+      load_rotated<W>(data, row_bytes, c, last - r, t1);
+      store_block<W>(data, row_bytes, c, last - r, t0);
+      load_rotated<W>(data, row_bytes, last - r, last - c, t0);
+      store_block<W>(data, row_bytes, last - r, last - c, t1);
+      load_rotated<W>(data, row_bytes, last - c, r, t1);
+      store_block<W>(data, row_bytes, last - c, r, t0);
+      store_block<W>(data, row_bytes, r, c, t1);
+    }
+  }
+}
+
+// The size of a `BitMatrix`: a constant for a compile-time N, a member
+// otherwise
+template <std::size_t N>
+struct Extent {
+  constexpr explicit Extent(std::size_t) {}
+  constexpr std::size_t value() const { return N; }
+};
+
+template <>
+struct Extent<0> {
+  explicit Extent(const std::size_t n) : n_(n) {}
+  std::size_t value() const { return n_; }
+
+  std::size_t n_;
+};
+
+}  // namespace detail
+
+// An owned N by N bit matrix, see the top of this file. N = 0 means that the
+// size is given at run time
+template <std::size_t N = 0>
+class BitMatrix {
+  static_assert(N % 64 == 0, "N must be a multiple of 64");
+
+ public:
+  // A compile-time N sized matrix, zeroed
+  BitMatrix() : BitMatrix(N) {
+    static_assert(N > 0, "BitMatrix<> needs its size at run time");
+  }
+
+  // An `n` by `n` matrix, zeroed. `n` must be a positive multiple of 64, and
+  // N if that is given. Throws std::bad_alloc if out of memory
+  explicit BitMatrix(const std::size_t n) : extent_(n) {
+    if (n == 0 || n % 64 || (N && n != N)) {
+      throw std::invalid_argument("BitMatrix: bad size");
+    }
+    data_ = static_cast<std::uint8_t *>(std::aligned_alloc(64, bytes()));
+    if (!data_) {
+      throw std::bad_alloc();
+    }
+    std::memset(data_, 0, bytes());
+  }
+
+  BitMatrix(const BitMatrix &) = delete;
+  BitMatrix &operator=(const BitMatrix &) = delete;
+
+  BitMatrix(BitMatrix &&other) noexcept
+      : extent_(other.extent_), data_(std::exchange(other.data_, nullptr)) {}
+
+  BitMatrix &operator=(BitMatrix &&other) noexcept {
+    if (this != &other) {
+      std::free(data_);
+      extent_ = other.extent_;
+      data_ = std::exchange(other.data_, nullptr);
+    }
+    return *this;
+  }
+
+  ~BitMatrix() { std::free(data_); }
+
+  // An explicit copy
+  BitMatrix clone() const {
+    BitMatrix copy(size());
+    std::memcpy(copy.data_, data_, bytes());
+    return copy;
+  }
+
+  std::size_t size() const { return extent_.value(); }
+  std::size_t row_bytes() const { return size() / 8; }
+  std::size_t bytes() const { return row_bytes() * size(); }
+
+  // The rows of the matrix, to pass to librotate.h. Null after a move
+  std::uint8_t *data() { return data_; }
+  const std::uint8_t *data() const { return data_; }
+
+  // The bit at column `i` of row `j`. The origin is the top left
+  bool get(const std::size_t i, const std::size_t j) const {
+    return data_[j * row_bytes() + i / 8] & (0x80 >> (i % 8));
+  }
+
+  void set(const std::size_t i, const std::size_t j, const bool value) {
+    std::uint8_t &byte = data_[j * row_bytes() + i / 8];
+    const std::uint8_t mask = 0x80 >> (i % 8);
+    byte = value ? byte | mask : byte & ~mask;
+  }
+
+  // Rotates the matrix clockwise 90 degrees in W by W bit blocks. A run-time
+  // size that is not a multiple of W is rotated in 64-bit blocks
+  template <std::size_t W = 64>
+  void rotate() {
+    static_assert(W == 32 || W == 64 || W == 128,
+                  "blocks are 32, 64 or 128 bits wide");
+    static_assert(N % W == 0 || W == 64,
+                  "N must be a multiple of the block width");
+    if constexpr (N > 0) {
+      detail::rotate_blocks<W>(data_, N);
+    } else if (size() % W) {
+      detail::rotate_blocks<64>(data_, size());
+    } else {
+      detail::rotate_blocks<W>(data_, size());
+    }
+  }
+
+ private:
+  detail::Extent<N> extent_;
+  std::uint8_t *data_;
+};
+
+}  // namespace librotate
+
+#endif  // BIT_MATRIX_HPP
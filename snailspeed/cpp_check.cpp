@@ -0,0 +1,123 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+// Checks the C++ headers against the C rotation of librotate: every block
+// width of `BitMatrix<N>::rotate<W>()` with a compile-time and a run-time
+// size, and a rotation awaited in a coroutine with `rotate_async()`. Built
+// and run by `make cppcheck`
+
+#include <atomic>
+#include <coroutine>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+
+#include "bit_matrix.hpp"
+#include "librotate.h"
+#include "rotate_async.hpp"
+
+namespace {
+
+// A coroutine that starts right away and is not waited on
+struct Task {
+  struct promise_type {
+    Task get_return_object() { return {}; }
+    std::suspend_never initial_suspend() { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+// Fills `matrix` with a pattern that has no symmetry a rotation preserves
+template <std::size_t N>
+void fill(librotate::BitMatrix<N> &matrix) {
+  std::uint64_t state = matrix.size();
+  for (std::size_t b = 0; b < matrix.bytes(); b++) {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    matrix.data()[b] = state >> 56;
+  }
+}
+
+// Compares `actual` with the rotation of `original` by rotate_bit_matrix()
+template <std::size_t N>
+bool check(const char *name, const librotate::BitMatrix<N> &original,
+           const librotate::BitMatrix<N> &actual) {
+  librotate::BitMatrix<N> expected = original.clone();
+  rotate_bit_matrix(expected.data(), expected.size());
+
+  const bool equal = !std::memcmp(expected.data(), actual.data(), actual.bytes());
+  std::printf("%s: %s of a %zux%zu matrix\n", equal ? "PASS" : "FAIL", name,
+              actual.size(), actual.size());
+  return equal;
+}
+
+template <std::size_t W, std::size_t N>
+bool check_rotate(const char *name, const std::size_t n) {
+  librotate::BitMatrix<N> original(n);
+  fill(original);
+  librotate::BitMatrix<N> actual = original.clone();
+  actual.template rotate<W>();
+  return check(name, original, actual);
+}
+
+std::atomic<bool> resumed{false};
+rotate_status_e async_status = ROTATE_PENDING;
+
+Task rotate_in_coroutine(librotate::BitMatrix<> &matrix) {
+  async_status = co_await librotate::rotate_async(matrix);
+  resumed.store(true);
+  resumed.notify_one();
+}
+
+bool check_async(const std::size_t n) {
+  librotate::BitMatrix<> original(n);
+  fill(original);
+  librotate::BitMatrix<> actual = original.clone();
+
+  rotate_in_coroutine(actual);
+  resumed.wait(false);
+  if (async_status != ROTATE_DONE) {
+    std::printf("FAIL: co_await rotate_async() returned %d\n", async_status);
+    return false;
+  }
+  return check("co_await rotate_async()", original, actual);
+}
+
+}  // namespace
+
+int main() {
+  bool result = true;
+  result &= check_rotate<32, 1024>("BitMatrix<1024>::rotate<32>()", 1024);
+  result &= check_rotate<64, 1024>("BitMatrix<1024>::rotate<64>()", 1024);
+  result &= check_rotate<128, 1024>("BitMatrix<1024>::rotate<128>()", 1024);
+  result &= check_rotate<32, 0>("BitMatrix<>::rotate<32>()", 1024);
+  result &= check_rotate<64, 0>("BitMatrix<>::rotate<64>()", 1024);
+  result &= check_rotate<128, 0>("BitMatrix<>::rotate<128>()", 1024);
+
+  // Not a multiple of 128, which falls back to 64-bit blocks
+  result &= check_rotate<128, 0>("BitMatrix<>::rotate<128>()", 192);
+  result &= check_async(2048);
+
+  std::printf("Result: %s\n", result ? "PASS" : "FAIL");
+  return result ? 0 : 1;
+}
@@ -0,0 +1,113 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#include "../utils/utils.h"
+#include "my_utils.h"
+#include <string.h>
+
+
+// Sets up `dirty` to track the 64x64 blocks of an `N` by `N` bit matrix.
+// Every block starts out clean.
+//
+// Returns false if there is not enough memory
+bool dirty_tiles_init(struct dirty_tiles_s *dirty, const bits_t N) {
+  assert(N > 0 && N % 64 == 0);
+
+  dirty->blocks_per_row = N / 64;
+  dirty->nwords = ((bytes_t) dirty->blocks_per_row * dirty->blocks_per_row + 63) / 64;
+  dirty->bits = calloc(dirty->nwords, sizeof(uint64_t));
+
+  return dirty->bits != NULL;
+}
+
+void dirty_tiles_free(struct dirty_tiles_s *dirty) {
+  free(dirty->bits);
+  dirty->bits = NULL;
+}
+
+// Marks the block holding bit (`i`, `j`) as dirty
+void dirty_tiles_mark(struct dirty_tiles_s *dirty, uint32_t i, uint32_t j) {
+  const bytes_t idx = (bytes_t) (j / 64) * dirty->blocks_per_row + i / 64;
+  dirty->bits[idx / 64] |= 1ULL << (idx % 64);
+}
+
+// Marks every block overlapping the `w` by `h` bit rectangle at (`x`, `y`)
+// as dirty. Bulk writers call this once instead of once per bit
+void dirty_tiles_mark_rect(struct dirty_tiles_s *dirty, uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+  if (w == 0 || h == 0) {
+    return;
+  }
+
+  for (uint32_t by = y / 64; by <= (y + h - 1) / 64; by++) {
+    for (uint32_t bx = x / 64; bx <= (x + w - 1) / 64; bx++) {
+      const bytes_t idx = (bytes_t) by * dirty->blocks_per_row + bx;
+      dirty->bits[idx / 64] |= 1ULL << (idx % 64);
+    }
+  }
+}
+
+// Marks every block as dirty, e.g. before the first incremental rotation
+void dirty_tiles_mark_all(struct dirty_tiles_s *dirty) {
+  const bytes_t nblocks = (bytes_t) dirty->blocks_per_row * dirty->blocks_per_row;
+  memset(dirty->bits, 0xFF, nblocks / 64 * sizeof(uint64_t));
+  if (nblocks % 64) {
+    dirty->bits[nblocks / 64] = (1ULL << (nblocks % 64)) - 1;
+  }
+}
+
+// Same as set_bit(), but also marks the block holding the bit as dirty
+void set_bit_tracked(uint8_t *img, const bytes_t row_size, uint32_t i, uint32_t j, uint8_t value,
+                     struct dirty_tiles_s *dirty) {
+  set_bit(img, row_size, i, j, value);
+  dirty_tiles_mark(dirty, i, j);
+}
+
+// Updates `dst`, which must already hold the clockwise rotation of `src` as
+// of the last call (or have every block marked dirty), to the rotation of the
+// current `src` by rotating only the dirty source blocks. Clears `dirty`.
+//
+// The work scales with the number of dirty blocks, not with `N`
+void rotate_dirty_tiles(const uint8_t *src, uint8_t *dst, const bits_t N, struct dirty_tiles_s *dirty) {
+  assert(N / 64 == dirty->blocks_per_row);
+  assert(src != dst);
+
+  uint64_t *int64_src = (uint64_t *) src;
+  uint64_t *int64_dst = (uint64_t *) dst;
+  const uint32_t row_size = N / 64;
+  uint64_t block[64];
+
+  for (bytes_t word = 0; word < dirty->nwords; word++) {
+    uint64_t bits = dirty->bits[word];
+    dirty->bits[word] = 0;
+
+    while (bits) {
+      const bytes_t idx = word * 64 + __builtin_ctzll(bits);
+      bits &= bits - 1;
+
+      // the block at (i, j) lands at (N - j - 64, i)
+      const uint32_t i = (idx % row_size) * 64, j = (idx / row_size) * 64;
+      get_block_64(int64_src, row_size, i, j, block);
+      rotate_and_set_block_64(int64_dst, row_size, N - j - 64, i, block);
+    }
+  }
+}
@@ -0,0 +1,87 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#include "../utils/parallel.h"
+#include "my_utils.h"
+#include <string.h>
+
+
+// Rotates on the pool of rotate_submit() and waits for it. If the rotation
+// cannot be submitted, for lack of memory or threads, rotates on the calling
+// thread instead
+static void rotate_bit_matrix_async(uint8_t *img, size_t N) {
+  struct rotate_job_s *job = rotate_submit(img, N, NULL, NULL, NULL);
+  if (!job) {
+    rotate_bit_matrix(img, N);
+    return;
+  }
+  rotate_wait(job);
+  rotate_job_release(job);
+}
+
+// The kernels that rotate_find_kernel() knows, the default first
+static const struct {
+  const char *name;
+  rotate_kernel_t fn;
+} kernels[] = {
+  {"inline", rotate_bit_matrix},
+  {"helper", rotate_bit_matrix_helper},
+  {"block128", rotate_bit_matrix_128},
+  {"block256", rotate_bit_matrix_256},
+  {"async", rotate_bit_matrix_async},
+};
+
+#define NKERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+// Returns the kernel called `name`, or NULL if there is none:
+//   "inline"    rotate_bit_matrix(), which prefetches inline
+//   "helper"    rotate_bit_matrix_helper(), which prefetches from a thread on
+//               the sibling hyperthread
+//   "block128"  rotate_bit_matrix_128(), in 128x128 bit blocks
+//   "block256"  rotate_bit_matrix_256(), in 256x256 bit blocks
+//   "async"     rotate_submit() and rotate_wait(), on the pool of threads,
+//               or rotate_bit_matrix() if the pool cannot take the rotation
+rotate_kernel_t rotate_find_kernel(const char *name) {
+  for (size_t k = 0; k < NKERNELS; k++) {
+    if (!strcmp(kernels[k].name, name)) {
+      return kernels[k].fn;
+    }
+  }
+  return NULL;
+}
+
+// Returns the name of kernel `index`, or NULL past the last one. Index 0 is
+// the default kernel
+const char *rotate_kernel_name(size_t index) {
+  return index < NKERNELS ? kernels[index].name : NULL;
+}
+
+// Sets the number of threads of the pool of rotate_submit(), which is sized
+// by its first submission. 0 means one per online CPU, which is the default
+void rotate_set_nthreads(uint32_t nthreads) {
+  parallel_set_nthreads(nthreads);
+}
+
+uint32_t rotate_nthreads(void) {
+  return parallel_nthreads();
+}
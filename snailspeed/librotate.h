@@ -0,0 +1,165 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+// The public interface of librotate: the rotations, their kernels and
+// threads, and the buffers to rotate. Built with `make librotate.a` or
+// `make librotate.so`, which leave out the test harness.
+//
+// An N by N bit matrix is N rows of N / 8 bytes, with the leftmost bit of a
+// row in the most significant bit of its first byte, and N a multiple of 64
+
+#ifndef LIBROTATE_H
+#define LIBROTATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bumped when the interface changes in a way that breaks callers
+#define ROTATE_API_VERSION 1
+
+// Transforms that can be fused into the store of every rotated block
+enum block_op_e {
+    BLOCK_OP_NONE,    // store the rotated block as is
+    BLOCK_OP_INVERT,  // invert the polarity
+    BLOCK_OP_XOR,     // XOR with the mask plane
+    BLOCK_OP_OR,      // OR with the mask plane, e.g. an overlay
+    BLOCK_OP_AND,     // AND with the mask plane, e.g. a threshold merge
+};
+
+// How the cells of a thumbnail are reduced to a single bit
+enum downsample_mode_e {
+    DOWNSAMPLE_OR,        // set if any bit of the cell is set
+    DOWNSAMPLE_MAJORITY,  // set if at least half the bits of the cell are set
+};
+
+// A thumbnail of the rotated image, downsampled by `factor` (2, 4 or 8) in
+// both directions. `data` is an N/factor by N/factor bit matrix with rows of
+// N/factor/8 bytes, laid out like the image
+struct thumbnail_s {
+    uint32_t factor;
+    enum downsample_mode_e mode;
+    uint8_t *data;
+};
+
+// Per-block post-op applied in registers before a rotated block is stored.
+// `mask` is only read by the XOR/OR/AND ops: it is an N by N bit matrix in
+// the rotated (destination) frame with the same layout as the image.
+// The `nthumbs` thumbnails are reduced from each block while it is still in
+// cache, after the op is applied
+struct block_post_s {
+    enum block_op_e op;
+    const uint64_t *mask;
+    struct thumbnail_s *thumbs;
+    uint32_t nthumbs;
+};
+
+// One dirty bit per 64x64 block of an N by N bit matrix, row-major over the
+// block grid. Set by the tracked writers, cleared by rotate_dirty_tiles()
+struct dirty_tiles_s {
+    uint64_t *bits;
+    size_t nwords;
+    uint32_t blocks_per_row;
+};
+
+enum rotate_status_e {
+    ROTATE_PENDING,    // more steps are needed
+    ROTATE_DONE,       // the matrix is fully rotated
+    ROTATE_CANCELLED,  // rotate_cancel() was called, see rotate_cancel()
+};
+
+// A resumable rotation, see rotate_begin(). Its layout is private: get one
+// from rotate_ctx_create()
+struct rotate_ctx_s;
+
+// An asynchronous rotation, see rotate_submit(). Its layout is private
+struct rotate_job_s;
+
+// Called on a pool thread when the asynchronous rotation `job` finishes, after
+// its status is published. It must not block on other rotations
+typedef void (*rotate_callback_t)(struct rotate_job_s *job, enum rotate_status_e status, void *arg);
+
+// A rotation kernel: rotates the `N` by `N` bit matrix `img` clockwise in place
+typedef void (*rotate_kernel_t)(uint8_t *img, size_t N);
+
+// Rotation entry points
+void rotate_bit_matrix(uint8_t *img, size_t N);
+void rotate_bit_matrix_post(uint8_t *img, size_t N, const struct block_post_s *post);
+void rotate_bit_matrix_thumbnails(uint8_t *img, size_t N, struct thumbnail_s thumbs[], uint32_t nthumbs);
+void rotate_bit_matrix_helper(uint8_t *img, size_t N);
+void rotate_bit_matrix_128(uint8_t *img, size_t N);
+void rotate_bit_matrix_256(uint8_t *img, size_t N);
+size_t rotate_region_row_size(uint32_t h);
+void rotate_region(const uint8_t *src, size_t N, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint8_t *dst);
+
+// Kernel selection
+rotate_kernel_t rotate_find_kernel(const char *name);
+const char *rotate_kernel_name(size_t index);
+
+// Threads of the parallel work of the library, e.g. pre-faulting buffers,
+// and of the pool of rotate_submit()
+void rotate_set_nthreads(uint32_t nthreads);
+uint32_t rotate_nthreads(void);
+
+// Incremental re-rotation of dirty tiles
+bool dirty_tiles_init(struct dirty_tiles_s *dirty, size_t N);
+void dirty_tiles_free(struct dirty_tiles_s *dirty);
+void dirty_tiles_mark(struct dirty_tiles_s *dirty, uint32_t i, uint32_t j);
+void dirty_tiles_mark_rect(struct dirty_tiles_s *dirty, uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+void dirty_tiles_mark_all(struct dirty_tiles_s *dirty);
+void set_bit_tracked(uint8_t *img, size_t row_size, uint32_t i, uint32_t j, uint8_t value,
+                     struct dirty_tiles_s *dirty);
+void rotate_dirty_tiles(const uint8_t *src, uint8_t *dst, size_t N, struct dirty_tiles_s *dirty);
+
+// Resumable rotation with bounded pauses
+struct rotate_ctx_s *rotate_ctx_create(void);
+void rotate_ctx_destroy(struct rotate_ctx_s *ctx);
+void rotate_begin(struct rotate_ctx_s *ctx, uint8_t *img, size_t N, const struct block_post_s *post);
+enum rotate_status_e rotate_step(struct rotate_ctx_s *ctx, uint64_t budget_ns, uint64_t budget_blocks);
+void rotate_cancel(struct rotate_ctx_s *ctx);
+uint64_t rotate_progress(struct rotate_ctx_s *ctx, uint64_t *total_blocks);
+
+// Asynchronous rotation on a pool of threads
+struct rotate_job_s *rotate_submit(uint8_t *img, size_t N, const struct block_post_s *post,
+                                   rotate_callback_t callback, void *arg);
+enum rotate_status_e rotate_poll(struct rotate_job_s *job);
+enum rotate_status_e rotate_wait(struct rotate_job_s *job);
+void rotate_job_cancel(struct rotate_job_s *job);
+void rotate_job_release(struct rotate_job_s *job);
+
+// Matrix buffers, 64-byte aligned and reused between calls
+uint8_t *matrix_alloc(size_t nbytes);
+void matrix_free(uint8_t *buffer);
+void matrix_pool_reserve(size_t nbytes, uint32_t count);
+void matrix_pool_set_limit(size_t nbytes);
+void matrix_pool_trim(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LIBROTATE_H
@@ -24,18 +24,42 @@
 #include "my_utils.h"
 #include <string.h>
 
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
 
 // get, set, and rotate for block size = 64
-void get_block_64(uint64_t *img, const bytes_t row_size, uint32_t i, uint32_t j, uint64_t block_dst[]) {
+static inline __attribute__((always_inline))
+void _get_block_64(uint64_t *img, const bytes_t row_size, uint32_t i, uint32_t j, uint64_t block_dst[],
+                   const bool prefetch) {
+
+    PROFILE_START(start);
 
     int word_offset = i / 64;
     for (int y = 0; y < 64; y++) {
-        __builtin_prefetch(&img[(j + y + 16) * row_size + word_offset]);
+        if (prefetch) {
+            __builtin_prefetch(&img[(j + y + 16) * row_size + word_offset]);
+        }
         block_dst[y] = __builtin_bswap64(img[(j + y) * row_size + word_offset]);
     }
+
+    PROFILE_STOP(PROFILE_GATHER, start);
 }
 
-void rotate_and_set_block_64(uint64_t *img, const bytes_t row_size, uint32_t di, uint32_t dj, uint64_t block[]) {
+void get_block_64(uint64_t *img, const bytes_t row_size, uint32_t i, uint32_t j, uint64_t block_dst[]) {
+    _get_block_64(img, row_size, i, j, block_dst, true);
+}
+
+// get_block_64() without the inline prefetch, for when a helper thread has
+// already brought the block in, see rotate_bit_matrix_helper()
+void get_block_64_noprefetch(uint64_t *img, const bytes_t row_size, uint32_t i, uint32_t j, uint64_t block_dst[]) {
+    _get_block_64(img, row_size, i, j, block_dst, false);
+}
+
+// rotate the 64x64 block 90 degrees clockwise with the row-column-row
+// algorithm, leaving row y of the rotated block in rotated[y]
+void rotate_block_64(uint64_t block[], uint64_t rotated[]) {
 
     // rotate row r left by r + 1
     for (int r = 0; r < 64; r++) {
@@ -43,7 +67,7 @@ void rotate_and_set_block_64(uint64_t *img, const bytes_t row_size, uint32_t di,
     }
 
     // rotate column c down by c + 1
-    uint64_t scratch[64];
+    uint64_t *scratch = rotated;
     int r;
     for (r = 0; r < 32; r++) {
         scratch[r] = (block[r] & 0xFFFFFFFF00000000) | (block[r + 32] & 0x00000000FFFFFFFF);
@@ -87,11 +111,271 @@ void rotate_and_set_block_64(uint64_t *img, const bytes_t row_size, uint32_t di,
     for (r = 0; r < 63; r++) {
         scratch[r + 1] = block[r];
     }
-    
-    // rotate row r left by r and set back to the destination in the matrix
-    int word_offset = di / 64;
+
+    // rotate row r left by r
     for (int y = 0; y < 64; y++) {
         scratch[y] = __builtin_rotateleft64(scratch[y], y);
-        img[(dj + y) * row_size + word_offset] = __builtin_bswap64(scratch[y]);
     }
-}
\ No newline at end of file
+}
+
+// set the rotated block back to the destination in the matrix, applying `op`
+// on the way. The switch on `op` is outside the store loops, so every op gets
+// a loop of its own, and callers with a constant `op` only keep theirs
+static inline __attribute__((always_inline))
+void store_block_64(uint64_t *img, const bytes_t row_size, uint32_t di, uint32_t dj, const uint64_t rotated[],
+                    const enum block_op_e op, const uint64_t *mask) {
+
+    int word_offset = di / 64;
+    switch (op) {
+    case BLOCK_OP_NONE:
+        for (int y = 0; y < 64; y++) {
+            img[(dj + y) * row_size + word_offset] = __builtin_bswap64(rotated[y]);
+        }
+        break;
+    case BLOCK_OP_INVERT:
+        for (int y = 0; y < 64; y++) {
+            img[(dj + y) * row_size + word_offset] = ~__builtin_bswap64(rotated[y]);
+        }
+        break;
+    case BLOCK_OP_XOR:
+        for (int y = 0; y < 64; y++) {
+            bytes_t idx = (dj + y) * row_size + word_offset;
+            img[idx] = __builtin_bswap64(rotated[y]) ^ mask[idx];
+        }
+        break;
+    case BLOCK_OP_OR:
+        for (int y = 0; y < 64; y++) {
+            bytes_t idx = (dj + y) * row_size + word_offset;
+            img[idx] = __builtin_bswap64(rotated[y]) | mask[idx];
+        }
+        break;
+    case BLOCK_OP_AND:
+        for (int y = 0; y < 64; y++) {
+            bytes_t idx = (dj + y) * row_size + word_offset;
+            img[idx] = __builtin_bswap64(rotated[y]) & mask[idx];
+        }
+        break;
+    }
+}
+
+// gather the bits of `v` selected by `mask` into the low bits of the result
+static inline uint64_t compress_bits_64(uint64_t v, uint64_t mask) {
+#ifdef __BMI2__
+    return _pext_u64(v, mask);
+#else
+    uint64_t ret = 0;
+    for (uint64_t bit = 1; mask; bit <<= 1) {
+        if (v & mask & -mask) {
+            ret |= bit;
+        }
+        mask &= mask - 1;
+    }
+    return ret;
+#endif
+}
+
+// reduce `factor` consecutive rows of a rotated block to one thumbnail row of
+// 64 / factor bits, with the leftmost cell in the most significant bit
+static inline uint64_t downsample_rows_64(const uint64_t rows[], const uint32_t factor,
+                                          const enum downsample_mode_e mode) {
+
+    // the top bit of every factor-bit cell
+    const uint64_t cell_tops = factor == 2 ? 0xAAAAAAAAAAAAAAAA : factor == 4 ? 0x8888888888888888 : 0x8080808080808080;
+
+    if (mode == DOWNSAMPLE_OR) {
+        uint64_t v = 0;
+        for (uint32_t r = 0; r < factor; r++) {
+            v |= rows[r];
+        }
+        // fold every cell into its top bit, shifts never cross into the next cell's top bit
+        for (uint32_t s = 1; s < factor; s <<= 1) {
+            v |= v << s;
+        }
+        return compress_bits_64(v, cell_tops);
+    }
+
+    // majority: count the bits of every cell of every row, then add the rows
+    // up in fields of 2 * factor bits so the sums cannot overflow, splitting
+    // the even and the odd cells
+    const uint64_t pair_masks[] = {0x5555555555555555, 0x3333333333333333, 0, 0x0F0F0F0F0F0F0F0F};
+    const uint64_t even_cells = factor == 2 ? 0x3333333333333333 : factor == 4 ? 0x0F0F0F0F0F0F0F0F : 0x00FF00FF00FF00FF;
+    const uint64_t field_ones = factor == 2 ? 0x1111111111111111 : factor == 4 ? 0x0101010101010101 : 0x0001000100010001;
+
+    uint64_t sum_even = 0, sum_odd = 0;
+    for (uint32_t r = 0; r < factor; r++) {
+        uint64_t h = rows[r];
+        for (uint32_t s = 1; s < factor; s <<= 1) {
+            h = (h & pair_masks[s - 1]) + ((h >> s) & pair_masks[s - 1]);
+        }
+        sum_even += h & even_cells;
+        sum_odd += (h >> factor) & even_cells;
+    }
+
+    // the top bit of a field becomes set once its sum reaches the threshold
+    const uint64_t threshold = factor * factor / 2;
+    const uint64_t field_top = 1ULL << (2 * factor - 1);
+    const uint64_t bias = (field_top - threshold) * field_ones;
+    const uint64_t tops = field_top * field_ones;
+
+    // move every flag to the top bit of its cell
+    uint64_t flags = (((sum_even + bias) & tops) >> factor) | ((sum_odd + bias) & tops);
+    return compress_bits_64(flags, cell_tops);
+}
+
+// reduce the block just stored at (di, dj) into every thumbnail in `post`
+static void downsample_block_64(uint64_t *img, const bytes_t row_size, uint32_t di, uint32_t dj,
+                                const struct block_post_s *post) {
+
+    // read back the final rows, they are still in L1
+    uint64_t rows[64];
+    int word_offset = di / 64;
+    for (int y = 0; y < 64; y++) {
+        rows[y] = __builtin_bswap64(img[(dj + y) * row_size + word_offset]);
+    }
+
+    for (uint32_t t = 0; t < post->nthumbs; t++) {
+        const struct thumbnail_s *thumb = &post->thumbs[t];
+        const uint32_t factor = thumb->factor;
+        const bytes_t thumb_row_size = row_size * 8 / factor;
+        uint8_t *dst = thumb->data + (dj / factor) * thumb_row_size + di / factor / 8;
+
+        for (uint32_t y = 0; y < 64; y += factor, dst += thumb_row_size) {
+            uint64_t row = downsample_rows_64(&rows[y], factor, thumb->mode);
+
+            // store the 64 / factor bits MSB-first
+            if (factor == 2) {
+                uint32_t v = __builtin_bswap32((uint32_t)row);
+                memcpy(dst, &v, sizeof(v));
+            } else if (factor == 4) {
+                uint16_t v = __builtin_bswap16((uint16_t)row);
+                memcpy(dst, &v, sizeof(v));
+            } else {
+                *dst = (uint8_t)row;
+            }
+        }
+    }
+}
+
+// store-only half of rotate_and_set_block_64(), for benchmarking the scatter
+void store_rotated_block_64(uint64_t *img, const bytes_t row_size, uint32_t di, uint32_t dj, const uint64_t rotated[]) {
+
+    store_block_64(img, row_size, di, dj, rotated, BLOCK_OP_NONE, NULL);
+}
+
+void rotate_and_set_block_64(uint64_t *img, const bytes_t row_size, uint32_t di, uint32_t dj, uint64_t block[]) {
+
+    uint64_t rotated[64];
+    PROFILE_START(start);
+    rotate_block_64(block, rotated);
+    PROFILE_STOP(PROFILE_RCR, start);
+
+    PROFILE_START(start_store);
+    store_block_64(img, row_size, di, dj, rotated, BLOCK_OP_NONE, NULL);
+    PROFILE_STOP(PROFILE_STORE, start_store);
+}
+
+// same as rotate_and_set_block_64(), but fuses `post` into the store so that
+// rotate+transform(+downsample) costs a single pass over the matrix
+void rotate_and_set_block_64_post(uint64_t *img, const bytes_t row_size, uint32_t di, uint32_t dj, uint64_t block[],
+                                  const struct block_post_s *post) {
+
+    uint64_t rotated[64];
+    PROFILE_START(start);
+    rotate_block_64(block, rotated);
+    PROFILE_STOP(PROFILE_RCR, start);
+
+    PROFILE_START(start_store);
+    store_block_64(img, row_size, di, dj, rotated, post->op, post->mask);
+
+    if (post->nthumbs) {
+        downsample_block_64(img, row_size, di, dj, post);
+    }
+    PROFILE_STOP(PROFILE_STORE, start_store);
+}
+
+// get, set, and rotate for wide blocks of `width` = 128 or 256 bits. A wide
+// block is kept as (width / 64)^2 blocks of 64x64 in the layout of
+// get_block_64(), row-major: block (a, b) holds the rows 64a to 64a + 63 of
+// word b of the wide rows. Rotating the wide block rotates every 64x64 block
+// and moves block (a, b) to (b, width / 64 - 1 - a), which is the
+// swap-halves recursion of the rotation ended at 64 bits
+static inline __attribute__((always_inline))
+void _get_block_wide(uint64_t *img, const bytes_t row_size, uint32_t i, uint32_t j, uint64_t blocks[],
+                     const uint32_t width) {
+
+    PROFILE_START(start);
+
+    const uint32_t k = width / 64;
+    const uint64_t *src = img + (bytes_t) j * row_size + i / 64;
+    for (uint32_t y = 0; y < width; y++) {
+        // one 128 or 256-bit load per row
+        uint64_t words[4];
+        memcpy(words, &src[(bytes_t) y * row_size], k * sizeof(uint64_t));
+        __builtin_prefetch(&src[(bytes_t) (y + 16) * row_size]);
+        for (uint32_t b = 0; b < k; b++) {
+            blocks[((y / 64) * k + b) * 64 + y % 64] = __builtin_bswap64(words[b]);
+        }
+    }
+
+    PROFILE_STOP(PROFILE_GATHER, start);
+}
+
+static inline __attribute__((always_inline))
+void _rotate_and_set_block_wide(uint64_t *img, const bytes_t row_size, uint32_t di, uint32_t dj, uint64_t blocks[],
+                                const struct block_post_s *post, const uint32_t width) {
+
+    const uint32_t k = width / 64;
+
+    // the post-ops work on 64x64 blocks, so store them one by one
+    if (post) {
+        for (uint32_t a = 0; a < k; a++) {
+            for (uint32_t b = 0; b < k; b++) {
+                rotate_and_set_block_64_post(img, row_size, di + 64 * (k - 1 - a), dj + 64 * b,
+                                             &blocks[(a * k + b) * 64], post);
+            }
+        }
+        return;
+    }
+
+    uint64_t rotated[16 * 64];
+    PROFILE_START(start);
+    for (uint32_t a = 0; a < k; a++) {
+        for (uint32_t b = 0; b < k; b++) {
+            rotate_block_64(&blocks[(a * k + b) * 64], &rotated[(b * k + k - 1 - a) * 64]);
+        }
+    }
+    PROFILE_STOP(PROFILE_RCR, start);
+
+    PROFILE_START(start_store);
+    uint64_t *dst = img + (bytes_t) dj * row_size + di / 64;
+    for (uint32_t y = 0; y < width; y++) {
+        uint64_t words[4];
+        for (uint32_t b = 0; b < k; b++) {
+            words[b] = __builtin_bswap64(rotated[((y / 64) * k + b) * 64 + y % 64]);
+        }
+        memcpy(&dst[(bytes_t) y * row_size], words, k * sizeof(uint64_t));
+    }
+    PROFILE_STOP(PROFILE_STORE, start_store);
+}
+
+void get_block_wide(uint64_t *img, const bytes_t row_size, uint32_t i, uint32_t j, uint64_t blocks[],
+                    const uint32_t width) {
+    assert(width == 128 || width == 256);
+    if (width == 128) {
+        _get_block_wide(img, row_size, i, j, blocks, 128);
+    } else {
+        _get_block_wide(img, row_size, i, j, blocks, 256);
+    }
+}
+
+// rotates the wide block `blocks` from get_block_wide() and stores it at
+// (di, dj), applying `post` if it is not NULL
+void rotate_and_set_block_wide(uint64_t *img, const bytes_t row_size, uint32_t di, uint32_t dj, uint64_t blocks[],
+                               const struct block_post_s *post, const uint32_t width) {
+    assert(width == 128 || width == 256);
+    if (width == 128) {
+        _rotate_and_set_block_wide(img, row_size, di, dj, blocks, post, 128);
+    } else {
+        _rotate_and_set_block_wide(img, row_size, di, dj, blocks, post, 256);
+    }
+}
@@ -25,16 +25,126 @@
 
 #include <assert.h>
 #include <malloc.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 
+#include "librotate.h"
+#include "rotate_profile.h"
+
+typedef size_t bits_t;
 typedef size_t bytes_t;
 
+// Position in the tile order of rotate_bit_matrix(): outer tiles row-major
+// over the top-left quadrant, then 64x64 blocks row-major inside each outer
+// tile. (`w`, `h`) is the top-left corner of the next rotation cycle
+struct tile_cursor_s {
+    uint32_t h_bound, w_bound;
+    uint32_t outer_tile_size;
+    uint32_t oh, ow, h, w;
+    bool done;
+};
+
+// A resumable rotation, see rotate_begin(). `progress` counts the blocks
+// moved so far out of `total_blocks` and may be read from any thread
+struct rotate_ctx_s {
+    uint8_t *img;
+    bits_t N;
+    const struct block_post_s *post;
+    struct tile_cursor_s cursor;
+    bool middle_pending;
+    uint64_t total_blocks;
+    _Atomic uint64_t progress;
+    atomic_bool cancelled;
+};
+
 // Your utility functions go here
+typedef void (*get_block_fn_t)(uint64_t *img, const bytes_t row_size, uint32_t i, uint32_t j, uint64_t block_dst[]);
+
 void get_block_64(uint64_t *img, const bytes_t row_size, uint32_t i, uint32_t j, uint64_t block_dst[]);
+void get_block_64_noprefetch(uint64_t *img, const bytes_t row_size, uint32_t i, uint32_t j, uint64_t block_dst[]);
+void rotate_block_64(uint64_t block[], uint64_t rotated[]);
+void store_rotated_block_64(uint64_t *img, const bytes_t row_size, uint32_t di, uint32_t dj, const uint64_t rotated[]);
 void rotate_and_set_block_64(uint64_t *img, const bytes_t row_size, uint32_t di, uint32_t dj, uint64_t block[]);
+void rotate_and_set_block_64_post(uint64_t *img, const bytes_t row_size, uint32_t di, uint32_t dj, uint64_t block[],
+                                  const struct block_post_s *post);
+void get_block_wide(uint64_t *img, const bytes_t row_size, uint32_t i, uint32_t j, uint64_t blocks[],
+                    const uint32_t width);
+void rotate_and_set_block_wide(uint64_t *img, const bytes_t row_size, uint32_t di, uint32_t dj, uint64_t blocks[],
+                               const struct block_post_s *post, const uint32_t width);
+
+// Rotates a block and applies `post`, if any, before storing it.
+//
+// `post` is NULL at compile time for the plain rotation, so the check folds away
+static inline __attribute__((always_inline))
+void rotate_and_set(uint64_t *img, const uint32_t row_size, uint32_t di, uint32_t dj, uint64_t block[],
+                    const struct block_post_s *post) {
+    if (post) {
+        rotate_and_set_block_64_post(img, row_size, di, dj, block, post);
+    } else {
+        rotate_and_set_block_64(img, row_size, di, dj, block);
+    }
+}
+
+// Moves the 4 blocks of one rotation cycle, starting with the block at
+// (`i`, `j`) in the top-left quadrant, to their rotated positions. The blocks
+// are read with `get_block`, which is a constant that inlines
+static inline __attribute__((always_inline))
+void rotate_cycle_64_with(uint64_t *img, const uint32_t row_size, const bits_t N, uint32_t i, uint32_t j,
+                          uint64_t tmp_block[], uint64_t save_block[], const struct block_post_s *post,
+                          const get_block_fn_t get_block) {
+    const uint32_t inner_tile_size = 64;
+    uint32_t ni = N - i - inner_tile_size, nj = N - j - inner_tile_size;
+
+    get_block(img, row_size, i, j, tmp_block);
+
+    get_block(img, row_size, nj, i, save_block);
+    rotate_and_set(img, row_size, nj, i, tmp_block, post);
+
+    get_block(img, row_size, ni, nj, tmp_block);
+    rotate_and_set(img, row_size, ni, nj, save_block, post);
+
+    get_block(img, row_size, j, ni, save_block);
+    rotate_and_set(img, row_size, j, ni, tmp_block, post);
+
+    rotate_and_set(img, row_size, i, j, save_block, post);
+}
+
+// rotate_cycle_64_with() reading the blocks with the prefetching get_block_64()
+static inline __attribute__((always_inline))
+void rotate_cycle_64(uint64_t *img, const uint32_t row_size, const bits_t N, uint32_t i, uint32_t j,
+                     uint64_t tmp_block[], uint64_t save_block[], const struct block_post_s *post) {
+    rotate_cycle_64_with(img, row_size, N, i, j, tmp_block, save_block, post, get_block_64);
+}
+
+// Moves the 4 wide blocks of one rotation cycle of `width` = 128 or 256 bit
+// blocks, like rotate_cycle_64(). `tmp_block` and `save_block` hold
+// (width / 64)^2 * 64 words
+static inline __attribute__((always_inline))
+void rotate_cycle_wide(uint64_t *img, const uint32_t row_size, const bits_t N, uint32_t i, uint32_t j,
+                       uint64_t tmp_block[], uint64_t save_block[], const struct block_post_s *post,
+                       const uint32_t width) {
+    uint32_t ni = N - i - width, nj = N - j - width;
+
+    get_block_wide(img, row_size, i, j, tmp_block, width);
+
+    get_block_wide(img, row_size, nj, i, save_block, width);
+    rotate_and_set_block_wide(img, row_size, nj, i, tmp_block, post, width);
+
+    get_block_wide(img, row_size, ni, nj, tmp_block, width);
+    rotate_and_set_block_wide(img, row_size, ni, nj, save_block, post, width);
+
+    get_block_wide(img, row_size, j, ni, save_block, width);
+    rotate_and_set_block_wide(img, row_size, j, ni, tmp_block, post, width);
+
+    rotate_and_set_block_wide(img, row_size, i, j, save_block, post, width);
+}
+
+// Tile order shared by the rotation loops
+void tile_cursor_init(struct tile_cursor_s *cursor, const bits_t N);
+bool tile_cursor_next(struct tile_cursor_s *cursor, uint32_t *i, uint32_t *j);
 
 #endif  // MY_UTILS_H
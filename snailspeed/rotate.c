@@ -20,80 +20,143 @@
  * IN THE SOFTWARE.
  **/
 
+#include "../utils/trace.h"
 #include "../utils/utils.h"
 #include "my_utils.h"
 #include <string.h>
 
 
-// Rotates a bit array clockwise 90 degrees.
-//
-// The bit array is of `N` by `N` bits where N is a multiple of 64
-void rotate_bit_matrix(uint8_t *img, const bits_t N) {
+// Moves one rotation cycle of `block_size` blocks, a constant at every call
+static inline __attribute__((always_inline))
+void rotate_cycle(uint64_t *img, const uint32_t row_size, const bits_t N, uint32_t i, uint32_t j,
+                  uint64_t tmp_block[], uint64_t save_block[], const struct block_post_s *post,
+                  const uint32_t block_size) {
+  if (block_size == 64) {
+    rotate_cycle_64(img, row_size, N, i, j, tmp_block, save_block, post);
+  } else {
+    rotate_cycle_wide(img, row_size, N, i, j, tmp_block, save_block, post, block_size);
+  }
+}
+
+// The tile loop of the rotation, in cycles of `block_size` = 64, 128 or 256
+// bit blocks. The wide blocks cover the top-left quadrant up to a multiple
+// of their size, and the strip along its inner edges that is left is
+// rotated in 64x64 blocks
+static inline __attribute__((always_inline))
+void _rotate_bit_matrix(uint8_t *img, const bits_t N, const struct block_post_s *post,
+                        const uint32_t block_size) {
 
   uint64_t *int64_img = (uint64_t *) img;
   const uint32_t outer_tile_size = 512;
-  const uint32_t inner_tile_size = 64;
+  const uint32_t inner_tile_size = block_size;
   const uint32_t row_size = N / 64;
 
-  uint64_t tmp_block[64], save_block[64];
+  uint64_t tmp_block[16 * 64], save_block[16 * 64];
   uint32_t h_bound = N/2, w_bound = N/2;
 
   // if odd case, set up different w_bound and handle the middle block
   if (row_size % 2 != 0) {
     w_bound = (row_size - 1) * 32;
     get_block_64(int64_img, row_size, w_bound, w_bound, tmp_block);
-    rotate_and_set_block_64(int64_img, row_size, w_bound, w_bound, tmp_block);
+    rotate_and_set(int64_img, row_size, w_bound, w_bound, tmp_block, post);
   }
 
+  const uint32_t h_wide = block_size == 64 ? h_bound : h_bound / block_size * block_size;
+  const uint32_t w_wide = block_size == 64 ? w_bound : w_bound / block_size * block_size;
+
   uint32_t ow, oh, w, h;
 
   // if matrix size is smaller than 2 * outer_tile_size, use 1-layer tiling
   // if not, matrix size is larger enough for 2-layer tiling
   if (N < 2 * outer_tile_size) {
-    for (h = 0; h < h_bound; h += inner_tile_size) {
-      for (w = 0; w < w_bound; w += inner_tile_size) {
-        
-        uint32_t i = w, j = h, ni = N - i - inner_tile_size, nj = N - j - inner_tile_size;
-  
-        get_block_64(int64_img, row_size, i, j, tmp_block);
-  
-        get_block_64(int64_img, row_size, nj, i, save_block);
-        rotate_and_set_block_64(int64_img, row_size, nj, i, tmp_block);
-  
-        get_block_64(int64_img, row_size, ni, nj, tmp_block);
-        rotate_and_set_block_64(int64_img, row_size, ni, nj, save_block);
-  
-        get_block_64(int64_img, row_size, j, ni, save_block);
-        rotate_and_set_block_64(int64_img, row_size, j, ni, tmp_block);
-  
-        rotate_and_set_block_64(int64_img, row_size, i, j, save_block);
+    PROFILE_BEGIN(N, N);
+    PROFILE_START(start);
+    const uint64_t trace_start = trace_enabled() ? trace_now() : 0;
+    for (h = 0; h < h_wide; h += inner_tile_size) {
+      for (w = 0; w < w_wide; w += inner_tile_size) {
+        rotate_cycle(int64_img, row_size, N, w, h, tmp_block, save_block, post, block_size);
       }
     }
+    trace_span(TRACE_TILE, "tile", trace_start, 0, 0);
+    PROFILE_TILE_STOP(0, 0, start);
   } else {
-    for (oh = 0; oh < h_bound; oh += outer_tile_size) {
-      for (ow = 0; ow < w_bound; ow += outer_tile_size) {
-        for (h = oh; h < oh + outer_tile_size && h < h_bound; h += inner_tile_size) {
-          for (w = ow; w < ow + outer_tile_size && w < w_bound; w += inner_tile_size) {
-            
-            uint32_t i = w, j = h, ni = N - i - inner_tile_size, nj = N - j - inner_tile_size;
-  
-            get_block_64(int64_img, row_size, i, j, tmp_block);
-  
-            get_block_64(int64_img, row_size, nj, i, save_block);
-            rotate_and_set_block_64(int64_img, row_size, nj, i, tmp_block);
-  
-            get_block_64(int64_img, row_size, ni, nj, tmp_block);
-            rotate_and_set_block_64(int64_img, row_size, ni, nj, save_block);
-  
-            get_block_64(int64_img, row_size, j, ni, save_block);
-            rotate_and_set_block_64(int64_img, row_size, j, ni, tmp_block);
-  
-            rotate_and_set_block_64(int64_img, row_size, i, j, save_block);
+    PROFILE_BEGIN(N, outer_tile_size);
+    for (oh = 0; oh < h_wide; oh += outer_tile_size) {
+      for (ow = 0; ow < w_wide; ow += outer_tile_size) {
+        PROFILE_START(start);
+        const uint64_t trace_start = trace_enabled() ? trace_now() : 0;
+        for (h = oh; h < oh + outer_tile_size && h < h_wide; h += inner_tile_size) {
+          for (w = ow; w < ow + outer_tile_size && w < w_wide; w += inner_tile_size) {
+            rotate_cycle(int64_img, row_size, N, w, h, tmp_block, save_block, post, block_size);
           }
         }
+        trace_span(TRACE_TILE, "tile", trace_start, oh, ow);
+        PROFILE_TILE_STOP(oh, ow, start);
       }
     } 
   }
 
+  // the strip of the quadrant that is too thin for a wide block
+  for (h = 0; h < h_bound; h += 64) {
+    for (w = h < h_wide ? w_wide : 0; w < w_bound; w += 64) {
+      rotate_cycle_64(int64_img, row_size, N, w, h, tmp_block, save_block, post);
+    }
+  }
+
   return;
-}
\ No newline at end of file
+}
+
+// Rotates a bit array clockwise 90 degrees.
+//
+// The bit array is of `N` by `N` bits where N is a multiple of 64
+void rotate_bit_matrix(uint8_t *img, const bits_t N) {
+  _rotate_bit_matrix(img, N, NULL, 64);
+}
+
+// Rotates a bit array clockwise 90 degrees in 128x128 bit blocks, which read
+// and write every row of a block with a single 128-bit access.
+//
+// The bit array is of `N` by `N` bits where N is a multiple of 64
+void rotate_bit_matrix_128(uint8_t *img, const bits_t N) {
+  _rotate_bit_matrix(img, N, NULL, 128);
+}
+
+// Rotates a bit array clockwise 90 degrees in 256x256 bit blocks, which read
+// and write every row of a block with a single 256-bit access.
+//
+// The bit array is of `N` by `N` bits where N is a multiple of 64
+void rotate_bit_matrix_256(uint8_t *img, const bits_t N) {
+  _rotate_bit_matrix(img, N, NULL, 256);
+}
+
+// Rotates a bit array clockwise 90 degrees and applies `post` to every
+// rotated block before it is stored, e.g. rotate+invert or rotate+mask in a
+// single pass over the matrix.
+//
+// The bit array is of `N` by `N` bits where N is a multiple of 64
+void rotate_bit_matrix_post(uint8_t *img, const bits_t N, const struct block_post_s *post) {
+  assert(post);
+  assert(post->op == BLOCK_OP_NONE || post->op == BLOCK_OP_INVERT || post->mask);
+  for (uint32_t t = 0; t < post->nthumbs; t++) {
+    const uint32_t factor = post->thumbs[t].factor;
+    assert(factor == 2 || factor == 4 || factor == 8);
+    assert(post->thumbs[t].data);
+  }
+
+  _rotate_bit_matrix(img, N, post, 64);
+}
+
+// Rotates a bit array clockwise 90 degrees and, in the same traversal, fills
+// in `nthumbs` downsampled copies of the rotated image
+//
+// The bit array is of `N` by `N` bits where N is a multiple of 64
+void rotate_bit_matrix_thumbnails(uint8_t *img, const bits_t N, struct thumbnail_s thumbs[], uint32_t nthumbs) {
+  const struct block_post_s post = {
+    .op = BLOCK_OP_NONE,
+    .mask = NULL,
+    .thumbs = thumbs,
+    .nthumbs = nthumbs,
+  };
+
+  rotate_bit_matrix_post(img, N, &post);
+}
@@ -0,0 +1,222 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+
+#include "../utils/parallel.h"
+#include "../utils/trace.h"
+#include "my_utils.h"
+#include <pthread.h>
+
+
+// Blocks a job rotates before it goes back to the end of the run queue and
+// its worker takes the next job. 1024 blocks are 512 KiB of matrix, a few
+// hundred microseconds of rotation
+#define ASYNC_SLICE_BLOCKS 1024
+
+struct rotate_job_s {
+  struct rotate_ctx_s ctx;
+  rotate_callback_t callback;
+  void *arg;
+
+  // An enum rotate_status_e, ROTATE_PENDING until the job finishes
+  _Atomic int status;
+
+  // One reference for the caller, one for the pool until the job finishes
+  atomic_uint refs;
+
+  struct rotate_job_s *next;
+};
+
+// The jobs that are not finished and not being stepped by a worker, in the
+// order they get their next slice
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  pthread_cond_t finished;
+  struct rotate_job_s *head;
+  struct rotate_job_s *tail;
+
+  // The workers that were started, 0 until the first submission
+  uint32_t nworkers;
+} run_queue = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .ready = PTHREAD_COND_INITIALIZER,
+    .finished = PTHREAD_COND_INITIALIZER,
+};
+
+// Appends `job` to the run queue. Called with the lock held
+static void push_job(struct rotate_job_s *job) {
+  job->next = NULL;
+  if (run_queue.tail) {
+    run_queue.tail->next = job;
+  } else {
+    run_queue.head = job;
+  }
+  run_queue.tail = job;
+  pthread_cond_signal(&run_queue.ready);
+}
+
+// Publishes the status of `job` before its callback runs, so that code the
+// callback resumes sees the job finished, and rotate_wait() does not hold
+// up its callers while the callback keeps the worker busy
+static void finish_job(struct rotate_job_s *job, const enum rotate_status_e status) {
+  pthread_mutex_lock(&run_queue.lock);
+  atomic_store(&job->status, status);
+  pthread_cond_broadcast(&run_queue.finished);
+  pthread_mutex_unlock(&run_queue.lock);
+
+  if (job->callback) {
+    job->callback(job, status, job->arg);
+  }
+  rotate_job_release(job);
+}
+
+// Gives the jobs of the run queue slices of ASYNC_SLICE_BLOCKS in turn, so
+// that a small job submitted behind a big one finishes after a few slices of
+// the big one rather than after all of it
+static void *async_worker(void *arg) {
+  (void) arg;
+  trace_set_thread_name("async worker");
+  for (;;) {
+    pthread_mutex_lock(&run_queue.lock);
+    while (!run_queue.head) {
+      pthread_cond_wait(&run_queue.ready, &run_queue.lock);
+    }
+    struct rotate_job_s *job = run_queue.head;
+    run_queue.head = job->next;
+    if (!run_queue.head) {
+      run_queue.tail = NULL;
+    }
+    pthread_mutex_unlock(&run_queue.lock);
+
+    const uint64_t trace_start = trace_enabled() ? trace_now() : 0;
+    const uint64_t begin = rotate_progress(&job->ctx, NULL);
+    const enum rotate_status_e status = rotate_step(&job->ctx, 0, ASYNC_SLICE_BLOCKS);
+    trace_span(TRACE_CHUNK, "slice", trace_start, begin, rotate_progress(&job->ctx, NULL));
+    if (status == ROTATE_PENDING) {
+      pthread_mutex_lock(&run_queue.lock);
+      push_job(job);
+      pthread_mutex_unlock(&run_queue.lock);
+    } else {
+      finish_job(job, status);
+    }
+  }
+  return NULL;
+}
+
+// Starts up to rotate_nthreads() workers, which live as long as the
+// process, and counts those that started. Called with the lock held
+static void start_workers(void) {
+  const uint32_t nworkers = parallel_nthreads();
+  pthread_attr_t attr;
+  if (pthread_attr_init(&attr)) {
+    return;
+  }
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  for (uint32_t w = 0; w < nworkers; w++) {
+    pthread_t thread;
+    if (pthread_create(&thread, &attr, async_worker, NULL)) {
+      break;
+    }
+    run_queue.nworkers++;
+  }
+  pthread_attr_destroy(&attr);
+}
+
+// Queues a clockwise rotation of the `N` by `N` bit matrix `img`, applying
+// `post` (which may be NULL) like rotate_bit_matrix_post(), and returns its
+// handle right away. Returns NULL if N is not a multiple of 64, out of
+// memory, or if no thread of the pool could be started.
+//
+// The rotation runs on a pool of up to rotate_nthreads() threads, started by
+// the first submission, or by the next one if none could be started. Jobs
+// take turns in slices of cycles, so concurrent submissions progress
+// together. Once it finishes, rotate_poll() and rotate_wait() return the
+// status, and then `callback` (if not NULL) is called on a pool thread with
+// the status and `arg`. The handle stays valid during the callback even if
+// the caller has released it. The worker takes no other job until the
+// callback returns, so the callback must not block, e.g. in rotate_wait() on
+// another job, which could deadlock the pool.
+//
+// `img` and `post` must stay valid until the rotation finishes. The handle
+// must be released with rotate_job_release()
+struct rotate_job_s *rotate_submit(uint8_t *img, const bits_t N, const struct block_post_s *post,
+                                   rotate_callback_t callback, void *arg) {
+  if (N < 64 || N % 64 != 0) {
+    return NULL;
+  }
+  struct rotate_job_s *job = calloc(1, sizeof(*job));
+  if (!job) {
+    return NULL;
+  }
+
+  rotate_begin(&job->ctx, img, N, post);
+  job->callback = callback;
+  job->arg = arg;
+  atomic_init(&job->status, ROTATE_PENDING);
+  atomic_init(&job->refs, 2);
+
+  pthread_mutex_lock(&run_queue.lock);
+  if (!run_queue.nworkers) {
+    start_workers();
+  }
+  if (!run_queue.nworkers) {
+    pthread_mutex_unlock(&run_queue.lock);
+    free(job);
+    return NULL;
+  }
+  push_job(job);
+  pthread_mutex_unlock(&run_queue.lock);
+  return job;
+}
+
+// Returns ROTATE_PENDING until the rotation finishes, then ROTATE_DONE or
+// ROTATE_CANCELLED
+enum rotate_status_e rotate_poll(struct rotate_job_s *job) {
+  return atomic_load(&job->status);
+}
+
+// Waits for the rotation to finish. Its callback may still be running
+enum rotate_status_e rotate_wait(struct rotate_job_s *job) {
+  if (atomic_load(&job->status) == ROTATE_PENDING) {
+    pthread_mutex_lock(&run_queue.lock);
+    while (atomic_load(&job->status) == ROTATE_PENDING) {
+      pthread_cond_wait(&run_queue.finished, &run_queue.lock);
+    }
+    pthread_mutex_unlock(&run_queue.lock);
+  }
+  return atomic_load(&job->status);
+}
+
+// Asks the rotation to stop at its next cycle boundary, like rotate_cancel()
+void rotate_job_cancel(struct rotate_job_s *job) {
+  rotate_cancel(&job->ctx);
+}
+
+// Releases the handle. A rotation that has not finished still runs to the
+// end, and its callback is still called
+void rotate_job_release(struct rotate_job_s *job) {
+  if (atomic_fetch_sub(&job->refs, 1) == 1) {
+    free(job);
+  }
+}
@@ -0,0 +1,109 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+
+
+// A C++20 coroutine interface to the asynchronous rotations of librotate.h.
+//
+// `co_await librotate::rotate_async(img, N)` submits the rotation with
+// rotate_submit() and suspends the coroutine until it finishes, without
+// blocking a thread, then evaluates to its enum rotate_status_e. The
+// coroutine resumes on the librotate thread that finished the rotation, and
+// that thread takes no other rotation until the coroutine suspends again or
+// returns. The continuation must never block, e.g. in rotate_wait(), which
+// can deadlock the pool; long work after the co_await should move to a
+// thread of the caller's own.
+//
+// The matrix must stay valid until the co_await completes. Needs librotate
+// linked in, unlike bit_matrix.hpp
+
+#ifndef ROTATE_ASYNC_HPP
+#define ROTATE_ASYNC_HPP
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+
+#include "bit_matrix.hpp"
+#include "librotate.h"
+
+namespace librotate {
+
+class RotateAwaitable {
+ public:
+  RotateAwaitable(std::uint8_t *img, const std::size_t n, const block_post_s *post = nullptr)
+      : img_(img), n_(n), post_(post) {
+    if (n == 0 || n % 64) {
+      throw std::invalid_argument("rotate_async: bad size");
+    }
+  }
+
+  RotateAwaitable(const RotateAwaitable &) = delete;
+  RotateAwaitable &operator=(const RotateAwaitable &) = delete;
+
+  bool await_ready() const noexcept { return false; }
+
+  // The rotation may finish, and resume the coroutine on another thread,
+  // before rotate_submit() returns, so nothing here touches `this` after it
+  void await_suspend(const std::coroutine_handle<> caller) {
+    caller_ = caller;
+    rotate_job_s *job = rotate_submit(img_, n_, post_, &RotateAwaitable::finished, this);
+    if (!job) {
+      throw std::bad_alloc();
+    }
+    rotate_job_release(job);
+  }
+
+  rotate_status_e await_resume() const noexcept { return status_; }
+
+ private:
+  // Runs the continuation on the pool thread, see rotate_submit(). Nothing
+  // after the co_await may block on librotate, or the pool may deadlock
+  static void finished(rotate_job_s *, const rotate_status_e status, void *arg) {
+    auto *self = static_cast<RotateAwaitable *>(arg);
+    self->status_ = status;
+    self->caller_.resume();
+  }
+
+  std::uint8_t *img_;
+  std::size_t n_;
+  const block_post_s *post_;
+  std::coroutine_handle<> caller_;
+  rotate_status_e status_ = ROTATE_PENDING;
+};
+
+inline RotateAwaitable rotate_async(std::uint8_t *img, const std::size_t n,
+                                    const block_post_s *post = nullptr) {
+  return RotateAwaitable(img, n, post);
+}
+
+template <std::size_t N>
+RotateAwaitable rotate_async(BitMatrix<N> &matrix, const block_post_s *post = nullptr) {
+  return RotateAwaitable(matrix.data(), matrix.size(), post);
+}
+
+}  // namespace librotate
+
+#endif  // ROTATE_ASYNC_HPP
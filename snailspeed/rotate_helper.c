@@ -0,0 +1,195 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#define _GNU_SOURCE  // For `sched_getcpu` and `pthread_setaffinity_np`
+#include "../utils/machine.h"
+#include "../utils/trace.h"
+#include "../utils/utils.h"
+#include "my_utils.h"
+#include <pthread.h>
+#include <sched.h>
+
+
+// How many rotation cycles the helper may run ahead of the rotation. A cycle
+// touches 4 blocks of 64 lines, 16 KiB, so at most 128 KiB are in flight,
+// which stays in L2 until the rotation gets to it
+#define HELPER_LEAD_CYCLES 8
+
+struct prefetch_helper_s {
+  uint64_t *img;
+  uint32_t row_size;
+  bits_t N;
+
+  // The CPU of the helper, -1 to leave it to the scheduler
+  int cpu;
+
+  // The number of cycles the rotation has finished, and set once it is done
+  _Atomic uint64_t done;
+  atomic_bool stop;
+};
+
+// Prefetches every line of the 64x64 block at (`i`, `j`) for writing, so
+// that it is in the cache shared with the sibling hyperthread when the
+// rotation reads and then overwrites it. A prefetch is not a read of the
+// matrix, so it does not race with the stores of the rotation
+static void prefetch_block(const uint64_t *img, const uint32_t row_size, uint32_t i, uint32_t j) {
+  const uint64_t *block = img + (bytes_t) j * row_size + i / 64;
+  for (int y = 0; y < 64; y++) {
+    __builtin_prefetch(&block[(bytes_t) y * row_size], 1, 3);
+  }
+}
+
+// Waits for the rotation. On a sibling hyperthread a pause gives the core
+// back to it, otherwise the helper shares a CPU and has to yield
+static inline void helper_wait(const struct prefetch_helper_s *helper) {
+#if defined(__x86_64__)
+  if (helper->cpu >= 0) {
+    __builtin_ia32_pause();
+    return;
+  }
+#endif
+  sched_yield();
+}
+
+// Walks the tile order of the rotation up to HELPER_LEAD_CYCLES ahead of it,
+// touching the 4 blocks of every cycle, which are both read and written by
+// the cycle. Cycles the rotation has already caught up with are skipped
+static void *prefetch_helper(void *arg) {
+  struct prefetch_helper_s *helper = arg;
+
+  if (helper->cpu >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(helper->cpu, &cpus);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus)) {
+      helper->cpu = -1;
+    }
+  }
+  trace_set_thread_name("prefetch helper");
+  const uint64_t trace_start = trace_enabled() ? trace_now() : 0;
+
+  const uint32_t inner_tile_size = 64;
+  struct tile_cursor_s cursor;
+  tile_cursor_init(&cursor, helper->N);
+
+  uint64_t cycle = 0;
+  uint32_t i, j;
+  while (tile_cursor_next(&cursor, &i, &j)) {
+    uint64_t done;
+    while (cycle >= (done = atomic_load_explicit(&helper->done, memory_order_relaxed)) + HELPER_LEAD_CYCLES) {
+      if (atomic_load_explicit(&helper->stop, memory_order_relaxed)) {
+        break;
+      }
+      helper_wait(helper);
+    }
+    if (atomic_load_explicit(&helper->stop, memory_order_relaxed)) {
+      break;
+    }
+
+    if (cycle >= done) {
+      const uint32_t ni = helper->N - i - inner_tile_size, nj = helper->N - j - inner_tile_size;
+      prefetch_block(helper->img, helper->row_size, i, j);
+      prefetch_block(helper->img, helper->row_size, nj, i);
+      prefetch_block(helper->img, helper->row_size, ni, nj);
+      prefetch_block(helper->img, helper->row_size, j, ni);
+    }
+    cycle++;
+  }
+
+  trace_span(TRACE_STAGE, "prefetch", trace_start, cycle, 0);
+  return NULL;
+}
+
+// Rotates a bit array clockwise 90 degrees, in the tile order of
+// rotate_bit_matrix(), with the lines of the upcoming rotation cycles
+// brought in by a helper thread instead of inline prefetches. The helper runs
+// on the sibling hyperthread of the rotation, which shares its L1 and L2.
+// Without a sibling it is left to the scheduler, which is only useful to
+// check it.
+//
+// The bit array is of `N` by `N` bits where N is a multiple of 64
+void rotate_bit_matrix_helper(uint8_t *img, const bits_t N) {
+  uint64_t *int64_img = (uint64_t *) img;
+  const uint32_t row_size = N / 64;
+  uint64_t tmp_block[64], save_block[64];
+
+  struct prefetch_helper_s helper = {
+    .img = int64_img,
+    .row_size = row_size,
+    .N = N,
+    .cpu = -1,
+  };
+  atomic_init(&helper.done, 0);
+  atomic_init(&helper.stop, false);
+
+  // Keep the rotation on its current core, next to the helper, if the
+  // sibling is one of the CPUs it may run on
+  cpu_set_t saved_cpus;
+  const int cpu = sched_getcpu();
+  const int sibling = cpu >= 0 ? detect_smt_sibling(cpu) : -1;
+  bool pinned = false;
+  if (sibling >= 0 && !pthread_getaffinity_np(pthread_self(), sizeof(saved_cpus), &saved_cpus) &&
+      CPU_ISSET(sibling, &saved_cpus)) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    pinned = !pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    helper.cpu = pinned ? sibling : -1;
+  }
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, prefetch_helper, &helper)) {
+    if (pinned) {
+      pthread_setaffinity_np(pthread_self(), sizeof(saved_cpus), &saved_cpus);
+    }
+    rotate_bit_matrix(img, N);
+    return;
+  }
+
+  // if odd case, handle the middle block
+  if (row_size % 2 != 0) {
+    const uint32_t middle = (row_size - 1) * 32;
+    get_block_64(int64_img, row_size, middle, middle, tmp_block);
+    rotate_and_set(int64_img, row_size, middle, middle, tmp_block, NULL);
+  }
+
+  struct tile_cursor_s cursor;
+  tile_cursor_init(&cursor, N);
+  const uint64_t trace_start = trace_enabled() ? trace_now() : 0;
+
+  uint64_t cycle = 0;
+  uint32_t i, j;
+  while (tile_cursor_next(&cursor, &i, &j)) {
+    rotate_cycle_64_with(int64_img, row_size, N, i, j, tmp_block, save_block, NULL, get_block_64_noprefetch);
+    atomic_store_explicit(&helper.done, ++cycle, memory_order_relaxed);
+  }
+
+  trace_span(TRACE_TILE, "helper rotation", trace_start, 0, 0);
+
+  atomic_store_explicit(&helper.stop, true, memory_order_relaxed);
+  pthread_join(thread, NULL);
+
+  if (pinned) {
+    pthread_setaffinity_np(pthread_self(), sizeof(saved_cpus), &saved_cpus);
+  }
+}
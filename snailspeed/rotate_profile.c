@@ -0,0 +1,274 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#include "my_utils.h"
+
+#ifdef ROTATE_PROFILE
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#define PROFILE_MAX_THREADS 64
+#define PROFILE_SLOWEST_TILES 5
+
+// Shades of the heatmap, from the fastest tile to the slowest
+static const char PROFILE_SHADES[] = " .:-=+*#%@";
+
+static const char *const PROFILE_PHASE_NAMES[PROFILE_NPHASES] = {
+  "gather", "rcr", "store",
+};
+
+// Phase totals of one thread, on their own cache line. Threads beyond
+// PROFILE_MAX_THREADS share the last slot, and its totals are approximate
+struct profile_thread_s {
+  uint64_t cycles[PROFILE_NPHASES];
+  uint64_t counts[PROFILE_NPHASES];
+} __attribute__((aligned(64)));
+
+static struct profile_thread_s profile_threads[PROFILE_MAX_THREADS];
+static atomic_uint profile_nthreads;
+static _Thread_local struct profile_thread_s *profile_self;
+
+// Cycles per outer tile of the top-left quadrant of one rotated size, and
+// the last thread that rotated each tile. Rotations of several threads may
+// run at once, so a grid is never changed in place: profile_begin() swaps in
+// a new grid when the size changes, and keeps the old one on the `retired`
+// list until rotate_profile_reset() in case a rotation still adds to it
+struct profile_grid_s {
+  size_t N;
+  uint32_t outer_tile_size, h_bound, w_bound;
+  uint32_t rows, cols;
+  _Atomic uint64_t calls;
+  _Atomic uint64_t *cycles;
+  _Atomic uint32_t *thread;
+  struct profile_grid_s *retired;
+};
+
+// The grid of the last rotated size
+static struct profile_grid_s *_Atomic profile_grid;
+static pthread_mutex_t profile_grid_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct profile_thread_s *profile_thread(void) {
+  if (!profile_self) {
+    const unsigned id = atomic_fetch_add_explicit(&profile_nthreads, 1, memory_order_relaxed);
+    profile_self = &profile_threads[id < PROFILE_MAX_THREADS ? id : PROFILE_MAX_THREADS - 1];
+  }
+  return profile_self;
+}
+
+void profile_phase_add(enum profile_phase_e phase, uint64_t cycles) {
+  struct profile_thread_s *self = profile_thread();
+  self->cycles[phase] += cycles;
+  self->counts[phase]++;
+}
+
+static bool grid_matches(const struct profile_grid_s *grid, size_t N, uint32_t outer_tile_size) {
+  return grid && grid->N == N && grid->outer_tile_size == outer_tile_size;
+}
+
+static void free_grids(struct profile_grid_s *grid) {
+  while (grid) {
+    struct profile_grid_s *retired = grid->retired;
+    free(grid->cycles);
+    free(grid->thread);
+    free(grid);
+    grid = retired;
+  }
+}
+
+// Starts the accounting of one rotation of an `N` by `N` matrix, tiled like
+// rotate_bit_matrix() with `outer_tile_size` tiles, and returns the grid to
+// add its tiles to. The tile grid is replaced whenever `N` changes, the
+// phase totals are kept
+struct profile_grid_s *profile_begin(size_t N, uint32_t outer_tile_size) {
+  struct profile_grid_s *grid = atomic_load_explicit(&profile_grid, memory_order_acquire);
+  if (grid_matches(grid, N, outer_tile_size)) {
+    atomic_fetch_add_explicit(&grid->calls, 1, memory_order_relaxed);
+    return grid;
+  }
+
+  pthread_mutex_lock(&profile_grid_lock);
+  grid = atomic_load_explicit(&profile_grid, memory_order_relaxed);
+  if (grid_matches(grid, N, outer_tile_size)) {
+    atomic_fetch_add_explicit(&grid->calls, 1, memory_order_relaxed);
+    pthread_mutex_unlock(&profile_grid_lock);
+    return grid;
+  }
+
+  struct profile_grid_s *fresh = calloc(1, sizeof(*fresh));
+  assert(fresh);
+  const uint32_t row_size = N / 64;
+  fresh->N = N;
+  fresh->outer_tile_size = outer_tile_size;
+  fresh->h_bound = N / 2;
+  fresh->w_bound = row_size % 2 != 0 ? (row_size - 1) * 32 : N / 2;
+  fresh->rows = (fresh->h_bound + outer_tile_size - 1) / outer_tile_size;
+  fresh->cols = (fresh->w_bound + outer_tile_size - 1) / outer_tile_size;
+  atomic_init(&fresh->calls, 1);
+
+  const size_t ntiles = (size_t)fresh->rows * fresh->cols;
+  fresh->cycles = calloc(ntiles ? ntiles : 1, sizeof(uint64_t));
+  fresh->thread = calloc(ntiles ? ntiles : 1, sizeof(uint32_t));
+  assert(fresh->cycles && fresh->thread);
+  fresh->retired = grid;
+
+  atomic_store_explicit(&profile_grid, fresh, memory_order_release);
+  pthread_mutex_unlock(&profile_grid_lock);
+  return fresh;
+}
+
+// Adds `cycles` to the outer tile of `grid` with the top-left corner (`ow`, `oh`)
+void profile_tile_add(struct profile_grid_s *grid, uint32_t oh, uint32_t ow, uint64_t cycles) {
+  const size_t tile = (size_t)(oh / grid->outer_tile_size) * grid->cols +
+                      ow / grid->outer_tile_size;
+
+  atomic_fetch_add_explicit(&grid->cycles[tile], cycles, memory_order_relaxed);
+  atomic_store_explicit(&grid->thread[tile], profile_thread() - profile_threads,
+                        memory_order_relaxed);
+}
+
+// Clears the phase totals and the tile grids. No rotation may run meanwhile
+void rotate_profile_reset(void) {
+  memset(profile_threads, 0, sizeof(profile_threads));
+
+  pthread_mutex_lock(&profile_grid_lock);
+  free_grids(atomic_exchange(&profile_grid, NULL));
+  pthread_mutex_unlock(&profile_grid_lock);
+}
+
+// Returns the number of blocks moved per rotation by the cycles of `tile`.
+// The bounds are rounded up like the `h < h_bound` loops of the rotation,
+// which also rotate the 64-bit row of cycles that straddles h_bound = N / 2
+// when the row size is odd
+static uint64_t tile_blocks(const struct profile_grid_s *grid, size_t tile) {
+  const uint32_t size = grid->outer_tile_size;
+  const uint32_t oh = tile / grid->cols * size, ow = tile % grid->cols * size;
+  const uint32_t h = ((oh + size < grid->h_bound ? size : grid->h_bound - oh) + 63) / 64;
+  const uint32_t w = ((ow + size < grid->w_bound ? size : grid->w_bound - ow) + 63) / 64;
+
+  return 4 * (uint64_t)h * w;
+}
+
+static double tile_cycles_per_block(const struct profile_grid_s *grid, size_t tile) {
+  const uint64_t blocks = tile_blocks(grid, tile) * grid->calls;
+  return blocks ? (double)grid->cycles[tile] / blocks : 0;
+}
+
+static int compare_double(const void *a, const void *b) {
+  const double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Prints the cycles per block of every phase and thread, then a heatmap of
+// the cycles per block of the outer tiles of the last rotated size and the
+// slowest tiles
+void rotate_profile_dump(FILE *f) {
+  const unsigned nthreads = profile_nthreads < PROFILE_MAX_THREADS ? profile_nthreads
+                                                                    : PROFILE_MAX_THREADS;
+
+  fprintf(f, "Rotation profile, TSC cycles per 64x64 block:\n\tthread");
+  for (int p = 0; p < PROFILE_NPHASES; p++) {
+    fprintf(f, " %10s", PROFILE_PHASE_NAMES[p]);
+  }
+  fprintf(f, " %12s\n", "blocks");
+
+  struct profile_thread_s total;
+  memset(&total, 0, sizeof(total));
+  for (unsigned t = 0; t <= nthreads; t++) {
+    const struct profile_thread_s *thread = t < nthreads ? &profile_threads[t] : &total;
+    if (t == nthreads) {
+      fprintf(f, "\t%6s", "total");
+    } else {
+      fprintf(f, "\t%6u", t);
+    }
+    for (int p = 0; p < PROFILE_NPHASES; p++) {
+      fprintf(f, " %10.1f", thread->counts[p] ? (double)thread->cycles[p] / thread->counts[p] : 0);
+      if (t < nthreads) {
+        total.cycles[p] += thread->cycles[p];
+        total.counts[p] += thread->counts[p];
+      }
+    }
+    fprintf(f, " %12" PRIu64 "\n", thread->counts[PROFILE_STORE]);
+  }
+
+  const struct profile_grid_s *grid = atomic_load_explicit(&profile_grid, memory_order_acquire);
+  const size_t ntiles = grid ? (size_t)grid->rows * grid->cols : 0;
+  if (!ntiles) {
+    return;
+  }
+
+  double *sorted = malloc(ntiles * sizeof(double));
+  assert(sorted);
+  for (size_t tile = 0; tile < ntiles; tile++) {
+    sorted[tile] = tile_cycles_per_block(grid, tile);
+  }
+  qsort(sorted, ntiles, sizeof(double), compare_double);
+  const double min = sorted[0], median = sorted[(ntiles - 1) / 2], max = sorted[ntiles - 1];
+
+  const int nshades = sizeof(PROFILE_SHADES) - 1;
+  fprintf(f,
+          "Outer tiles of the top-left quadrant, N = %zu, %u by %u tiles of up to %u bits, "
+          "%" PRIu64 " rotation%s.\n"
+          "Each tile also stands for its 3 rotated images. Cycles per block: min %.1f ('%c'), "
+          "median %.1f, max %.1f ('%c'):\n",
+          grid->N, grid->rows, grid->cols, grid->outer_tile_size,
+          grid->calls, grid->calls == 1 ? "" : "s", min, PROFILE_SHADES[0], median, max, PROFILE_SHADES[nshades - 1]);
+
+  for (uint32_t r = 0; r < grid->rows; r++) {
+    fprintf(f, "\t|");
+    for (uint32_t c = 0; c < grid->cols; c++) {
+      const double v = tile_cycles_per_block(grid, (size_t)r * grid->cols + c);
+      int shade = max > min ? (int)((v - min) / (max - min) * nshades) : 0;
+      fputc(PROFILE_SHADES[shade < nshades ? shade : nshades - 1], f);
+    }
+    fprintf(f, "|\n");
+  }
+
+  // The slowest tiles, picked by repeated selection since there are few
+  fprintf(f, "Slowest tiles:\n");
+  const size_t nslowest = ntiles < PROFILE_SLOWEST_TILES ? ntiles : PROFILE_SLOWEST_TILES;
+  double bound = max + 1;
+  for (size_t k = 0; k < nslowest; k++) {
+    size_t slowest = ntiles;
+    for (size_t tile = 0; tile < ntiles; tile++) {
+      const double v = tile_cycles_per_block(grid, tile);
+      if (v < bound && (slowest == ntiles || v > tile_cycles_per_block(grid, slowest))) {
+        slowest = tile;
+      }
+    }
+    if (slowest == ntiles) {
+      break;
+    }
+    bound = tile_cycles_per_block(grid, slowest);
+    fprintf(f, "\t(h, w) = (%u, %u): %.1f cycles/block, %.2fx the median, last rotated by thread %u\n",
+            (uint32_t)(slowest / grid->cols) * grid->outer_tile_size,
+            (uint32_t)(slowest % grid->cols) * grid->outer_tile_size, bound,
+            median > 0 ? bound / median : 0, grid->thread[slowest]);
+  }
+
+  free(sorted);
+}
+
+#endif  // ROTATE_PROFILE
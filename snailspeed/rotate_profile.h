@@ -0,0 +1,75 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#ifndef ROTATE_PROFILE_H
+#define ROTATE_PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Per-phase cycle accounting of the rotation hot path. It is only compiled
+// in with `make PROFILE=1`, which defines ROTATE_PROFILE; otherwise all the
+// PROFILE_* macros expand to nothing and the hot path is unchanged.
+//
+// TSC cycles and counts are kept per phase and per thread, and the cycles
+// of rotate_bit_matrix() per outer tile of the top-left quadrant, so that a
+// heatmap of slow tiles can be dumped with rotate_profile_dump(). Rotations
+// may run on several threads at once; rotate_profile_reset() and
+// rotate_profile_dump() must not run alongside them
+enum profile_phase_e {
+  PROFILE_GATHER,  // get_block_64()
+  PROFILE_RCR,     // rotate_block_64()
+  PROFILE_STORE,   // the scatter of the rotated block, with its post-op
+  PROFILE_NPHASES,
+};
+
+#ifdef ROTATE_PROFILE
+
+#include <x86intrin.h>
+
+// The tile grid of one rotated size, private to rotate_profile.c
+struct profile_grid_s;
+
+void profile_phase_add(enum profile_phase_e phase, uint64_t cycles);
+struct profile_grid_s *profile_begin(size_t N, uint32_t outer_tile_size);
+void profile_tile_add(struct profile_grid_s *grid, uint32_t oh, uint32_t ow, uint64_t cycles);
+void rotate_profile_reset(void);
+void rotate_profile_dump(FILE *f);
+
+#define PROFILE_START(t) const uint64_t t = __rdtsc()
+#define PROFILE_STOP(phase, t) profile_phase_add((phase), __rdtsc() - (t))
+#define PROFILE_BEGIN(N, outer_tile_size) \
+  struct profile_grid_s *const profile_grid_ = profile_begin((N), (outer_tile_size))
+#define PROFILE_TILE_STOP(oh, ow, t) profile_tile_add(profile_grid_, (oh), (ow), __rdtsc() - (t))
+
+#else
+
+#define PROFILE_START(t)
+#define PROFILE_STOP(phase, t)
+#define PROFILE_BEGIN(N, outer_tile_size)
+#define PROFILE_TILE_STOP(oh, ow, t)
+
+#endif  // ROTATE_PROFILE
+
+#endif  // ROTATE_PROFILE_H
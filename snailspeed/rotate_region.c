@@ -0,0 +1,96 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#include "../utils/utils.h"
+#include "my_utils.h"
+#include <string.h>
+
+
+// Loads the 64 bits of `row` starting at bit `x`, MSB-first. `x` need not be
+// word aligned: the two words it straddles are shifted and merged. Bits at or
+// past `x_end` are cleared
+static inline uint64_t load_bits_64(const uint64_t *img, const bytes_t row_size, uint32_t row, uint32_t x,
+                                    uint32_t x_end) {
+  const uint64_t *src = img + (bytes_t) row * row_size;
+  const uint32_t word = x / 64, shift = x % 64;
+
+  uint64_t bits = __builtin_bswap64(src[word]) << shift;
+  if (shift && word + 1 < row_size) {
+    bits |= __builtin_bswap64(src[word + 1]) >> (64 - shift);
+  }
+
+  if (x_end - x < 64) {
+    bits &= ~0ULL << (64 - (x_end - x));
+  }
+  return bits;
+}
+
+// Number of bytes per row of the destination of `rotate_region` for a window
+// of height `h`. Rows are padded to whole 64-bit words
+bytes_t rotate_region_row_size(uint32_t h) {
+  return (bytes_t) (h + 63) / 64 * 8;
+}
+
+// Rotates the `w` by `h` bit window at (`x`, `y`) of the `N` by `N` bit matrix
+// `src` clockwise 90 degrees into `dst`, without touching the rest of `src`.
+//
+// `dst` becomes an `h` bits wide, `w` rows tall bit matrix with rows of
+// `rotate_region_row_size(h)` bytes, and must be 8-byte aligned. The window
+// need not be block aligned. Its blocks are aligned to its bottom-left corner
+// so that every destination block lands on a word boundary; the bits that
+// fall outside of the window are read as 0, which zeroes the row padding
+void rotate_region(const uint8_t *src, const bits_t N, uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+                   uint8_t *dst) {
+  // Sanity check the input
+  assert(N % 64 == 0);
+  assert(w > 0 && h > 0);
+  assert((bits_t) x + w <= N && (bits_t) y + h <= N);
+
+  const uint64_t *int64_src = (const uint64_t *) src;
+  uint64_t *int64_dst = (uint64_t *) dst;
+  const bytes_t row_size = N / 64;
+  const bytes_t dst_row_size = rotate_region_row_size(h) / 8;
+
+  uint64_t block[64], rotated[64];
+
+  for (uint32_t by = 0; by < dst_row_size; by++) {
+    // source row of the top of this block, relative to the window. The top
+    // block sticks out above the window unless `h` is a multiple of 64
+    const int64_t v0 = (int64_t) h - 64 * (int64_t) (by + 1);
+
+    for (uint32_t u0 = 0; u0 < w; u0 += 64) {
+      for (int r = 0; r < 64; r++) {
+        const int64_t v = v0 + r;
+        block[r] = v < 0 ? 0 : load_bits_64(int64_src, row_size, y + v, x + u0, x + w);
+      }
+
+      rotate_block_64(block, rotated);
+
+      // source column u becomes destination row u
+      const uint32_t nrows = w - u0 < 64 ? w - u0 : 64;
+      for (uint32_t r = 0; r < nrows; r++) {
+        int64_dst[(u0 + r) * dst_row_size + by] = __builtin_bswap64(rotated[r]);
+      }
+    }
+  }
+}
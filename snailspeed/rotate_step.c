@@ -0,0 +1,185 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#include "../utils/utils.h"
+#include "../utils/fasttime.h"
+#include "my_utils.h"
+#include <string.h>
+
+
+// Sets up `cursor` at the first rotation cycle of an `N` by `N` matrix, with
+// the same bounds and tile sizes as rotate_bit_matrix(). The 1-layer tiling
+// of small matrices is the 2-layer tiling with a single outer tile
+void tile_cursor_init(struct tile_cursor_s *cursor, const bits_t N) {
+  const uint32_t outer_tile_size = 512;
+  const uint32_t row_size = N / 64;
+
+  cursor->h_bound = N / 2;
+  cursor->w_bound = row_size % 2 != 0 ? (row_size - 1) * 32 : N / 2;
+  cursor->outer_tile_size = N < 2 * outer_tile_size ? N : outer_tile_size;
+  cursor->oh = cursor->ow = cursor->h = cursor->w = 0;
+  cursor->done = cursor->h_bound == 0 || cursor->w_bound == 0;
+}
+
+// Saves the top-left corner of the next rotation cycle in (`i`, `j`) and
+// advances `cursor`. Returns false once every cycle has been visited
+bool tile_cursor_next(struct tile_cursor_s *cursor, uint32_t *i, uint32_t *j) {
+  const uint32_t inner_tile_size = 64;
+
+  if (cursor->done) {
+    return false;
+  }
+
+  *i = cursor->w;
+  *j = cursor->h;
+
+  cursor->w += inner_tile_size;
+  if (cursor->w < cursor->ow + cursor->outer_tile_size && cursor->w < cursor->w_bound) {
+    return true;
+  }
+
+  cursor->w = cursor->ow;
+  cursor->h += inner_tile_size;
+  if (cursor->h < cursor->oh + cursor->outer_tile_size && cursor->h < cursor->h_bound) {
+    return true;
+  }
+
+  // next outer tile
+  cursor->ow += cursor->outer_tile_size;
+  if (cursor->ow >= cursor->w_bound) {
+    cursor->ow = 0;
+    cursor->oh += cursor->outer_tile_size;
+    cursor->done = cursor->oh >= cursor->h_bound;
+  }
+  cursor->h = cursor->oh;
+  cursor->w = cursor->ow;
+
+  return true;
+}
+
+// Allocates a context for rotate_begin(), for callers that only see the
+// opaque struct rotate_ctx_s of librotate.h. Returns NULL if out of memory
+struct rotate_ctx_s *rotate_ctx_create(void) {
+  return calloc(1, sizeof(struct rotate_ctx_s));
+}
+
+void rotate_ctx_destroy(struct rotate_ctx_s *ctx) {
+  free(ctx);
+}
+
+// Starts a resumable clockwise rotation of the `N` by `N` bit matrix `img`,
+// applying `post` (which may be NULL) like rotate_bit_matrix_post(). No work
+// is done until rotate_step() is called.
+//
+// `img` and `post` must stay valid until the rotation is done or cancelled
+void rotate_begin(struct rotate_ctx_s *ctx, uint8_t *img, const bits_t N, const struct block_post_s *post) {
+  assert(N >= 64 && N % 64 == 0);
+
+  const uint32_t row_size = N / 64;
+
+  ctx->img = img;
+  ctx->N = N;
+  ctx->post = post;
+  tile_cursor_init(&ctx->cursor, N);
+  ctx->middle_pending = row_size % 2 != 0;
+
+  // every cycle moves 4 blocks, the middle block of an odd matrix moves alone
+  const uint64_t ncycles = (uint64_t) ((ctx->cursor.h_bound + 63) / 64) * (ctx->cursor.w_bound / 64);
+  ctx->total_blocks = 4 * ncycles + ctx->middle_pending;
+
+  atomic_store_explicit(&ctx->progress, 0, memory_order_relaxed);
+  atomic_store_explicit(&ctx->cancelled, false, memory_order_relaxed);
+}
+
+// Does up to `budget_ns` nanoseconds or `budget_blocks` blocks of rotation
+// work, whichever runs out first. A budget of 0 means no limit, and every
+// step moves at least one cycle or the middle block, however small its budget.
+//
+// Steps stop between rotation cycles, when every block is either in its
+// rotated position or untouched, so the matrix is always consistent and the
+// next step completes it. A step may overrun its budget by up to one cycle
+// (4 blocks).
+//
+// Returns ROTATE_DONE once the whole matrix is rotated
+enum rotate_status_e rotate_step(struct rotate_ctx_s *ctx, uint64_t budget_ns, uint64_t budget_blocks) {
+  uint64_t *int64_img = (uint64_t *) ctx->img;
+  const uint32_t row_size = ctx->N / 64;
+  uint64_t tmp_block[64], save_block[64];
+
+  const fasttime_t start = gettime();
+  uint64_t nblocks = 0;
+  uint32_t i, j;
+
+  if (ctx->middle_pending) {
+    const uint32_t middle = (row_size - 1) * 32;
+    get_block_64(int64_img, row_size, middle, middle, tmp_block);
+    rotate_and_set(int64_img, row_size, middle, middle, tmp_block, ctx->post);
+    ctx->middle_pending = false;
+
+    nblocks++;
+    atomic_fetch_add_explicit(&ctx->progress, 1, memory_order_relaxed);
+  }
+
+  while (!ctx->cursor.done) {
+    if (atomic_load_explicit(&ctx->cancelled, memory_order_relaxed)) {
+      return ROTATE_CANCELLED;
+    }
+    // every step moves something, however small its budget
+    if (nblocks && budget_blocks && nblocks >= budget_blocks) {
+      break;
+    }
+    if (nblocks && budget_ns && tdiff_nsec(start, gettime()) >= budget_ns) {
+      break;
+    }
+    if (!tile_cursor_next(&ctx->cursor, &i, &j)) {
+      break;
+    }
+
+    rotate_cycle_64(int64_img, row_size, ctx->N, i, j, tmp_block, save_block, ctx->post);
+
+    nblocks += 4;
+    atomic_fetch_add_explicit(&ctx->progress, 4, memory_order_relaxed);
+  }
+
+  return ctx->cursor.done ? ROTATE_DONE : ROTATE_PENDING;
+}
+
+// Asks the rotation to stop. May be called from any thread, including while
+// rotate_step() runs, which then returns ROTATE_CANCELLED at the next cycle
+// boundary. When the row size of the matrix is odd, the middle block is
+// rotated by the first step and counts as one block of progress, so the
+// matrix is left with the middle block and the first
+// (rotate_progress() - 1) / 4 cycles (in tile order) rotated, and with the
+// first rotate_progress() / 4 cycles otherwise. The rest is untouched
+void rotate_cancel(struct rotate_ctx_s *ctx) {
+  atomic_store_explicit(&ctx->cancelled, true, memory_order_relaxed);
+}
+
+// Returns the number of blocks moved so far and saves the total number of
+// blocks in `total_blocks`, if not NULL. Safe to call from any thread
+uint64_t rotate_progress(struct rotate_ctx_s *ctx, uint64_t *total_blocks) {
+  if (total_blocks) {
+    *total_blocks = ctx->total_blocks;
+  }
+  return atomic_load_explicit(&ctx->progress, memory_order_relaxed);
+}
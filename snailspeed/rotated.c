@@ -0,0 +1,584 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+
+// rotated, a rotation daemon. It keeps a pool of worker threads and rotates
+// the bit matrices that clients pass as shared memory over a Unix socket, see
+// rotated.h for the protocol. Compared to running `rotate` per image it saves
+// the process start and the page faults of a fresh buffer for every image:
+// the matrices are rotated in place in the pages of the client, which are
+// faulted in with one mmap call.
+//
+// The main thread accepts the connections and reads the requests, and queues
+// the rotations by priority; the workers run them and reply
+
+#define _GNU_SOURCE  // For `MAP_POPULATE`, `accept4` and `MSG_CMSG_CLOEXEC`
+#include "librotate.h"
+#include "rotated.h"
+#include "../utils/fasttime.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+#define MAX_CONNS 256
+
+// Rotations queued at most before new ones are rejected with ROTATED_EBUSY
+#define DEFAULT_QUEUE_LIMIT 1024
+
+// At most this many descriptors are taken from a message, the first is used
+#define MAX_PASSED_FDS 4
+
+// A client connection. It is referenced by the main thread until the client
+// hangs up, and by every queued rotation of the client
+struct conn_s {
+  int fd;
+  pthread_mutex_t send_lock;
+  atomic_uint refs;
+};
+
+struct job_s {
+  struct conn_s *conn;
+  uint64_t id;
+  int fd;
+  uint64_t offset;
+  size_t nbytes;
+  size_t N;
+  rotate_kernel_t kernel;
+  fasttime_t received;
+  struct job_s *next;
+};
+
+// The rotations waiting for a worker, a FIFO per priority, and the stats,
+// which are updated under the same lock
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  struct job_s *head[ROTATED_NPRIORITIES];
+  struct job_s *tail[ROTATED_NPRIORITIES];
+  uint32_t limit;
+  bool stopping;
+  struct rotated_stats_s stats;
+} queue = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .ready = PTHREAD_COND_INITIALIZER,
+    .limit = DEFAULT_QUEUE_LIMIT,
+};
+
+static rotate_kernel_t default_kernel;
+
+// Written by the signal handlers to wake up the main thread
+static int wake_pipe[2] = {-1, -1};
+static volatile sig_atomic_t stop_requested;
+
+static void request_stop(int sig) {
+  (void)sig;
+  stop_requested = 1;
+  const char byte = 0;
+  ssize_t r __attribute__((unused)) = write(wake_pipe[1], &byte, 1);
+}
+
+static struct conn_s *conn_create(const int fd) {
+  struct conn_s *conn = malloc(sizeof(*conn));
+  if (!conn) {
+    return NULL;
+  }
+  conn->fd = fd;
+  pthread_mutex_init(&conn->send_lock, NULL);
+  atomic_init(&conn->refs, 1);
+  return conn;
+}
+
+static void conn_release(struct conn_s *conn) {
+  if (atomic_fetch_sub(&conn->refs, 1) == 1) {
+    close(conn->fd);
+    pthread_mutex_destroy(&conn->send_lock);
+    free(conn);
+  }
+}
+
+// Sends `reply`, followed by `stats` if it is not NULL, as one message. A
+// client that has gone away is not an error: its replies are dropped
+static void send_reply(struct conn_s *conn, const struct rotated_reply_s *reply,
+                       const struct rotated_stats_s *stats) {
+  struct iovec iov[2] = {
+      {.iov_base = (void *)reply, .iov_len = sizeof(*reply)},
+      {.iov_base = (void *)stats, .iov_len = sizeof(*stats)},
+  };
+  struct msghdr msg = {.msg_iov = iov, .msg_iovlen = stats ? 2 : 1};
+
+  pthread_mutex_lock(&conn->send_lock);
+  ssize_t r __attribute__((unused)) = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+  pthread_mutex_unlock(&conn->send_lock);
+}
+
+static void reply_status(struct conn_s *conn, const uint64_t id,
+                         const enum rotated_status_e status) {
+  const struct rotated_reply_s reply = {
+      .magic = ROTATED_MAGIC, .status = status, .id = id};
+  send_reply(conn, &reply, NULL);
+}
+
+static void count_rejected(void) {
+  pthread_mutex_lock(&queue.lock);
+  queue.stats.received++;
+  queue.stats.rejected++;
+  pthread_mutex_unlock(&queue.lock);
+}
+
+// Queues `job`, or returns false if the queue is full
+static bool enqueue(struct job_s *job, const uint32_t priority) {
+  pthread_mutex_lock(&queue.lock);
+  struct rotated_stats_s *stats = &queue.stats;
+  stats->received++;
+  if (stats->queue_depth >= queue.limit) {
+    stats->rejected++;
+    pthread_mutex_unlock(&queue.lock);
+    return false;
+  }
+
+  stats->depth_hist[rotated_hist_bucket(stats->queue_depth)]++;
+  stats->queue_depth++;
+  stats->queued[priority]++;
+  if (stats->queue_depth > stats->max_queue_depth) {
+    stats->max_queue_depth = stats->queue_depth;
+  }
+
+  job->next = NULL;
+  if (queue.tail[priority]) {
+    queue.tail[priority]->next = job;
+  } else {
+    queue.head[priority] = job;
+  }
+  queue.tail[priority] = job;
+
+  pthread_cond_signal(&queue.ready);
+  pthread_mutex_unlock(&queue.lock);
+  return true;
+}
+
+// Returns the first job of the most urgent priority, or NULL once the daemon
+// stops and the queue is empty
+static struct job_s *dequeue(void) {
+  pthread_mutex_lock(&queue.lock);
+  while (!queue.stats.queue_depth && !queue.stopping) {
+    pthread_cond_wait(&queue.ready, &queue.lock);
+  }
+
+  struct job_s *job = NULL;
+  for (uint32_t p = 0; p < ROTATED_NPRIORITIES && !job; p++) {
+    job = queue.head[p];
+    if (job) {
+      queue.head[p] = job->next;
+      if (!queue.head[p]) {
+        queue.tail[p] = NULL;
+      }
+      queue.stats.queued[p]--;
+      queue.stats.queue_depth--;
+    }
+  }
+  pthread_mutex_unlock(&queue.lock);
+  return job;
+}
+
+static void *worker_main(void *arg) {
+  (void)arg;
+  struct job_s *job;
+  while ((job = dequeue())) {
+    // Mapped here rather than on receipt, so that faulting in the matrix does
+    // not hold up the main thread; queue_ns still counts from receipt
+    uint8_t *img = mmap(NULL, job->nbytes, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, job->fd, job->offset);
+    close(job->fd);
+    if (img == MAP_FAILED) {
+      reply_status(job->conn, job->id, ROTATED_EMAP);
+      pthread_mutex_lock(&queue.lock);
+      queue.stats.rejected++;
+      pthread_mutex_unlock(&queue.lock);
+      conn_release(job->conn);
+      free(job);
+      continue;
+    }
+
+    const fasttime_t start = gettime();
+    job->kernel(img, job->N);
+    const fasttime_t end = gettime();
+    munmap(img, job->nbytes);
+
+    const struct rotated_reply_s reply = {
+        .magic = ROTATED_MAGIC,
+        .status = ROTATED_OK,
+        .id = job->id,
+        .queue_ns = tdiff_nsec(job->received, start),
+        .rotate_ns = tdiff_nsec(start, end),
+    };
+    send_reply(job->conn, &reply, NULL);
+    const uint64_t latency_ns = tdiff_nsec(job->received, gettime());
+
+    pthread_mutex_lock(&queue.lock);
+    struct rotated_stats_s *stats = &queue.stats;
+    stats->completed++;
+    stats->queue_us_hist[rotated_hist_bucket(reply.queue_ns / 1000)]++;
+    stats->rotate_us_hist[rotated_hist_bucket(reply.rotate_ns / 1000)]++;
+    stats->latency_us_hist[rotated_hist_bucket(latency_ns / 1000)]++;
+    pthread_mutex_unlock(&queue.lock);
+
+    conn_release(job->conn);
+    free(job);
+  }
+  return NULL;
+}
+
+// Checks the matrix of `request` in `fd` and queues its rotation, which takes
+// over `fd` and maps it on its worker. Replies right away if the request
+// cannot be queued. Returns whether the queued rotation took `fd`.
+//
+// The descriptor must be sealed against shrinking: a client that truncated
+// it while the rotation is queued would otherwise kill the daemon with a
+// SIGBUS when a worker touches the mapping
+static bool handle_rotate(struct conn_s *conn,
+                          struct rotated_request_s *request, const int fd,
+                          const fasttime_t received) {
+  const uint64_t N = request->N;
+  rotate_kernel_t kernel = default_kernel;
+  enum rotated_status_e status = ROTATED_OK;
+
+  request->kernel[ROTATED_KERNEL_NAME_LEN - 1] = '\0';
+  if (request->kernel[0]) {
+    kernel = rotate_find_kernel(request->kernel);
+  }
+
+  struct stat st;
+  const int seals = fd < 0 ? -1 : fcntl(fd, F_GET_SEALS);
+  if (!N || N % 64 || N > ((uint64_t)1 << 24) ||
+      request->priority >= ROTATED_NPRIORITIES ||
+      request->offset % sysconf(_SC_PAGESIZE)) {
+    status = ROTATED_EINVAL;
+  } else if (!kernel) {
+    status = ROTATED_EKERNEL;
+  } else if (seals < 0 || !(seals & F_SEAL_SHRINK) || fstat(fd, &st) ||
+             (uint64_t)st.st_size < N * (N / 8) ||
+             request->offset > (uint64_t)st.st_size - N * (N / 8)) {
+    status = ROTATED_EMAP;
+  }
+
+  struct job_s *job = NULL;
+  if (status == ROTATED_OK) {
+    job = malloc(sizeof(*job));
+    if (!job) {
+      status = ROTATED_EBUSY;
+    }
+  }
+
+  if (status != ROTATED_OK) {
+    count_rejected();
+    reply_status(conn, request->id, status);
+    return false;
+  }
+
+  *job = (struct job_s){
+      .conn = conn,
+      .id = request->id,
+      .fd = fd,
+      .offset = request->offset,
+      .nbytes = N * (N / 8),
+      .N = N,
+      .kernel = kernel,
+      .received = received,
+  };
+  atomic_fetch_add(&conn->refs, 1);
+  if (!enqueue(job, request->priority)) {
+    free(job);
+    reply_status(conn, request->id, ROTATED_EBUSY);
+    conn_release(conn);
+    return false;
+  }
+  return true;
+}
+
+static void handle_stats(struct conn_s *conn, const uint64_t id) {
+  pthread_mutex_lock(&queue.lock);
+  const struct rotated_stats_s stats = queue.stats;
+  pthread_mutex_unlock(&queue.lock);
+
+  const struct rotated_reply_s reply = {
+      .magic = ROTATED_MAGIC, .status = ROTATED_OK, .id = id};
+  send_reply(conn, &reply, &stats);
+}
+
+// Reads and handles one request of `conn`. Returns false once the client
+// hangs up
+static bool handle_message(struct conn_s *conn) {
+  struct rotated_request_s request = {0};
+  union {
+    char buf[CMSG_SPACE(MAX_PASSED_FDS * sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  struct iovec iov = {.iov_base = &request, .iov_len = sizeof(request)};
+  struct msghdr msg = {
+      .msg_iov = &iov,
+      .msg_iovlen = 1,
+      .msg_control = control.buf,
+      .msg_controllen = sizeof(control.buf),
+  };
+
+  const ssize_t n = recvmsg(conn->fd, &msg, MSG_CMSG_CLOEXEC);
+  if (n <= 0) {
+    return n < 0 && errno == EINTR;
+  }
+  const fasttime_t received = gettime();
+
+  // Keep the first passed descriptor and close the rest
+  int fd = -1;
+  for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+    if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) {
+      continue;
+    }
+    const size_t nfds = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    for (size_t k = 0; k < nfds; k++) {
+      int passed;
+      memcpy(&passed, CMSG_DATA(c) + k * sizeof(int), sizeof(int));
+      if (fd < 0) {
+        fd = passed;
+      } else {
+        close(passed);
+      }
+    }
+  }
+
+  if ((size_t)n != sizeof(request) || (msg.msg_flags & MSG_TRUNC) ||
+      request.magic != ROTATED_MAGIC) {
+    count_rejected();
+    reply_status(conn, request.id, ROTATED_EINVAL);
+  } else if (request.op == ROTATED_OP_ROTATE) {
+    if (handle_rotate(conn, &request, fd, received)) {
+      fd = -1;
+    }
+  } else if (request.op == ROTATED_OP_STATS) {
+    handle_stats(conn, request.id);
+  } else if (request.op == ROTATED_OP_SHUTDOWN) {
+    reply_status(conn, request.id, ROTATED_OK);
+    stop_requested = 1;
+  } else {
+    count_rejected();
+    reply_status(conn, request.id, ROTATED_EINVAL);
+  }
+
+  if (fd >= 0) {
+    close(fd);
+  }
+  return true;
+}
+
+// Binds the listening socket at `path`. Refuses to replace the socket of a
+// daemon that still answers
+static int listen_at(const char *path) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    printf("Socket path too long: %s\n", path);
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+
+  const int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    perror("socket");
+    return -1;
+  }
+
+  if (!connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+    printf("A daemon is already listening at %s\n", path);
+    close(fd);
+    return -1;
+  }
+  unlink(path);
+
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+      listen(fd, SOMAXCONN)) {
+    perror(path);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Accepts connections and reads requests until a shutdown request or signal
+static void serve(const int listen_fd) {
+  struct pollfd fds[2 + MAX_CONNS];
+  struct conn_s *conns[MAX_CONNS];
+  uint32_t nconns = 0;
+
+  fds[0] = (struct pollfd){.fd = wake_pipe[0], .events = POLLIN};
+  fds[1] = (struct pollfd){.fd = listen_fd, .events = POLLIN};
+
+  while (!stop_requested) {
+    for (uint32_t c = 0; c < nconns; c++) {
+      fds[2 + c] = (struct pollfd){.fd = conns[c]->fd, .events = POLLIN};
+    }
+    if (poll(fds, 2 + nconns, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("poll");
+      break;
+    }
+
+    for (uint32_t c = nconns; c-- > 0;) {
+      if (fds[2 + c].revents && !handle_message(conns[c])) {
+        conn_release(conns[c]);
+        conns[c] = conns[--nconns];
+      }
+    }
+
+    if (fds[1].revents & POLLIN) {
+      const int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+      struct conn_s *conn = fd < 0 || nconns == MAX_CONNS ? NULL : conn_create(fd);
+      if (conn) {
+        conns[nconns++] = conn;
+      } else if (fd >= 0) {
+        close(fd);
+      }
+    }
+  }
+
+  for (uint32_t c = 0; c < nconns; c++) {
+    conn_release(conns[c]);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  const char *path = ROTATED_DEFAULT_SOCKET;
+  long nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+  default_kernel = rotate_bit_matrix;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "hs:w:K:q:")) != -1) {
+    switch (opt) {
+      case 's':  // Socket path
+        path = optarg;
+        break;
+
+      case 'w':  // Worker threads
+        nworkers = atol(optarg);
+        if (nworkers <= 0) {
+          printf("Invalid workers: MUST be a positive integer\n");
+          goto help;
+        }
+        break;
+
+      case 'K':  // Kernel of the requests that do not name one
+        default_kernel = rotate_find_kernel(optarg);
+        if (!default_kernel) {
+          printf("Invalid kernel: MUST be one of");
+          for (size_t k = 0; rotate_kernel_name(k); k++) {
+            printf(" %s", rotate_kernel_name(k));
+          }
+          printf("\n");
+          goto help;
+        }
+        break;
+
+      case 'q': {  // Queue limit
+        const long limit = atol(optarg);
+        if (limit <= 0 || limit > UINT32_MAX) {
+          printf("Invalid queue limit: MUST be a positive integer\n");
+          goto help;
+        }
+        queue.limit = limit;
+        break;
+      }
+
+      default:
+        goto help;
+    }
+  }
+  if (optind < argc) {
+    goto help;
+  }
+
+  if (pipe2(wake_pipe, O_CLOEXEC)) {
+    perror("pipe");
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, request_stop);
+  signal(SIGTERM, request_stop);
+
+  const int listen_fd = listen_at(path);
+  if (listen_fd < 0) {
+    return 1;
+  }
+
+  pthread_t *workers = malloc(nworkers * sizeof(*workers));
+  assert(workers);
+  queue.stats.nworkers = nworkers;
+  for (long w = 0; w < nworkers; w++) {
+    const int r = pthread_create(&workers[w], NULL, worker_main, NULL);
+    assert(!r);
+  }
+  printf("rotated: listening at %s with %ld workers\n", path, nworkers);
+  fflush(stdout);
+
+  serve(listen_fd);
+
+  // Stop taking requests, then let the workers finish the queued ones
+  close(listen_fd);
+  unlink(path);
+  pthread_mutex_lock(&queue.lock);
+  queue.stopping = true;
+  pthread_cond_broadcast(&queue.ready);
+  pthread_mutex_unlock(&queue.lock);
+  for (long w = 0; w < nworkers; w++) {
+    pthread_join(workers[w], NULL);
+  }
+  free(workers);
+
+  rotated_print_stats(stdout, &queue.stats);
+  return 0;
+
+help:
+  printf(
+      "Usage: %s [-s socket] [-w workers] [-K kernel] [-q queue-limit]\n"
+      "  -s  the Unix socket to listen at, %s by default\n"
+      "  -w  the worker threads that rotate, one per CPU by default\n"
+      "  -K  the kernel of the requests that do not name one, inline by "
+      "default\n"
+      "  -q  the rotations queued at most before new ones are rejected, %d "
+      "by default\n"
+      "SIGINT, SIGTERM or a shutdown request finish the queued rotations, "
+      "print the stats and exit\n",
+      argv[0], ROTATED_DEFAULT_SOCKET, DEFAULT_QUEUE_LIMIT);
+  return 1;
+}
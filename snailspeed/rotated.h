@@ -0,0 +1,125 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+
+// The protocol of rotated, the rotation daemon, and its clients.
+//
+// A client connects to the SOCK_SEQPACKET Unix socket of the daemon and sends
+// one `rotated_request_s` per message. A rotation request carries the bit
+// matrix as a file descriptor in SCM_RIGHTS ancillary data, usually a memfd:
+// the daemon maps it shared and rotates it in place, so the pixels are never
+// copied. The descriptor must carry the F_SEAL_SHRINK seal, e.g. a memfd
+// created with MFD_ALLOW_SEALING, so that the client cannot pull the pages
+// from under a queued rotation; unsealed descriptors are rejected with
+// ROTATED_EMAP. Every request is answered by one `rotated_reply_s`, in
+// completion order rather than request order, which a stats request follows
+// with a `rotated_stats_s` in the same message
+
+#ifndef ROTATED_H
+#define ROTATED_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define ROTATED_MAGIC 0x52544431  // "RTD1"
+
+#define ROTATED_DEFAULT_SOCKET "/tmp/rotated.sock"
+
+// Priority 0 is served first, and requests of the same priority in the order
+// they arrived
+#define ROTATED_NPRIORITIES 4
+
+// Bucket b of a histogram counts the values v with 2^(b - 1) <= v < 2^b, and
+// bucket 0 the zeros
+#define ROTATED_HIST_BUCKETS 32
+
+#define ROTATED_KERNEL_NAME_LEN 16
+
+enum rotated_op_e {
+  ROTATED_OP_ROTATE,    // rotate the matrix of the passed descriptor
+  ROTATED_OP_STATS,     // reply with the stats of the daemon
+  ROTATED_OP_SHUTDOWN,  // finish the queued rotations and exit
+};
+
+enum rotated_status_e {
+  ROTATED_OK,
+  ROTATED_EINVAL,   // malformed request, or N not a multiple of 64
+  ROTATED_EMAP,     // no descriptor, not sealed against shrinking, or it
+                    // could not be mapped
+  ROTATED_EKERNEL,  // no such kernel
+  ROTATED_EBUSY,    // the queue is full, try again later
+};
+
+struct rotated_request_s {
+  uint32_t magic;
+  uint32_t op;
+
+  // Returned in the reply, to match replies to requests
+  uint64_t id;
+
+  // The N by N bit matrix starts `offset` bytes into the descriptor, which
+  // must be a multiple of the page size
+  uint64_t N;
+  uint64_t offset;
+
+  uint32_t priority;
+
+  // The kernel, see rotate_find_kernel(), or empty for the daemon's default
+  char kernel[ROTATED_KERNEL_NAME_LEN];
+};
+
+struct rotated_reply_s {
+  uint32_t magic;
+  uint32_t status;
+  uint64_t id;
+
+  // Time from receipt to the start of the rotation, and of the rotation
+  uint64_t queue_ns;
+  uint64_t rotate_ns;
+};
+
+struct rotated_stats_s {
+  uint64_t received;
+  uint64_t completed;
+  uint64_t rejected;
+
+  // Requests waiting for a worker, now and at most
+  uint32_t queue_depth;
+  uint32_t max_queue_depth;
+  uint32_t queued[ROTATED_NPRIORITIES];
+  uint32_t nworkers;
+
+  // Histograms of the queue depth a request found when it arrived, and of
+  // the times of completed requests in microseconds: queued, rotating, and
+  // from receipt to reply
+  uint64_t depth_hist[ROTATED_HIST_BUCKETS];
+  uint64_t queue_us_hist[ROTATED_HIST_BUCKETS];
+  uint64_t rotate_us_hist[ROTATED_HIST_BUCKETS];
+  uint64_t latency_us_hist[ROTATED_HIST_BUCKETS];
+};
+
+uint32_t rotated_hist_bucket(const uint64_t value);
+
+void rotated_print_stats(FILE *f, const struct rotated_stats_s *stats);
+
+#endif  // ROTATED_H
@@ -0,0 +1,333 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+
+// rotated_client, a client of the rotation daemon, see rotated.c. It
+// generates a bit matrix in a memfd, has the daemon rotate `-n` copies of it
+// and checks them against a local rotation, and can ask the daemon for its
+// stats or to shut down
+
+#define _GNU_SOURCE  // For `memfd_create` and `F_ADD_SEALS`
+#include "../utils/utils.h"
+#include "librotate.h"
+#include "rotated.h"
+#include "../utils/fasttime.h"
+#include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+// Rotations in flight at most. The daemon replies while the client is still
+// sending, and the unread replies must fit in the socket buffer
+#define MAX_IN_FLIGHT 64
+
+static int connect_to(const char *path) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    printf("Socket path too long: %s\n", path);
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+
+  const int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    perror("socket");
+    return -1;
+  }
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+    perror(path);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Sends `request`, with `fd` attached unless it is negative
+static bool send_request(const int sock, const struct rotated_request_s *request,
+                         const int fd) {
+  union {
+    char buf[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  struct iovec iov = {.iov_base = (void *)request, .iov_len = sizeof(*request)};
+  struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1};
+
+  if (fd >= 0) {
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(c), &fd, sizeof(int));
+  }
+
+  if (sendmsg(sock, &msg, MSG_NOSIGNAL) != sizeof(*request)) {
+    perror("sendmsg");
+    return false;
+  }
+  return true;
+}
+
+// Receives a reply, and the stats that follow it if `stats` is not NULL
+static bool receive_reply(const int sock, struct rotated_reply_s *reply,
+                          struct rotated_stats_s *stats) {
+  struct iovec iov[2] = {
+      {.iov_base = reply, .iov_len = sizeof(*reply)},
+      {.iov_base = stats, .iov_len = sizeof(*stats)},
+  };
+  struct msghdr msg = {.msg_iov = iov, .msg_iovlen = stats ? 2 : 1};
+
+  const ssize_t n = recvmsg(sock, &msg, 0);
+  if (n < (ssize_t)sizeof(*reply) || reply->magic != ROTATED_MAGIC) {
+    printf("The daemon hung up or sent a malformed reply\n");
+    return false;
+  }
+  if (stats && n != sizeof(*reply) + sizeof(*stats)) {
+    printf("The daemon did not send its stats\n");
+    return false;
+  }
+  return true;
+}
+
+static const char *status_name(const uint32_t status) {
+  switch (status) {
+    case ROTATED_OK:
+      return "ok";
+    case ROTATED_EINVAL:
+      return "invalid request";
+    case ROTATED_EMAP:
+      return "cannot map the matrix";
+    case ROTATED_EKERNEL:
+      return "no such kernel";
+    case ROTATED_EBUSY:
+      return "queue full";
+    default:
+      return "unknown status";
+  }
+}
+
+// Has the daemon rotate `count` copies of a generated N by N matrix, each in
+// its own page-aligned slot of one memfd, and checks them
+static bool run_rotations(const int sock, const bits_t N, const uint32_t count,
+                          const uint32_t priority, const char *kernel) {
+  const bytes_t nbytes = N * bits_to_bytes(N);
+  const long page = sysconf(_SC_PAGESIZE);
+  const bytes_t slot = (nbytes + page - 1) / page * page;
+
+  // The daemon only maps memfds that cannot shrink, see rotated.h
+  const int fd = memfd_create("rotated_client", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0 || ftruncate(fd, slot * count) ||
+      fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK)) {
+    perror("memfd");
+    return false;
+  }
+  uint8_t *slots = mmap(NULL, slot * count, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0);
+  if (slots == MAP_FAILED) {
+    perror("mmap");
+    close(fd);
+    return false;
+  }
+
+  uint8_t *expected = generate_bit_matrix(N, false);
+  for (uint32_t k = 0; k < count; k++) {
+    matrix_copy(slots + k * slot, expected, nbytes);
+  }
+  rotate_bit_matrix(expected, N);
+
+  fasttime_t *sent = malloc(count * sizeof(*sent));
+  assert(sent);
+  uint32_t nsent = 0;
+  uint32_t nreplies = 0;
+  uint32_t nwrong = 0;
+  uint64_t latency_ns = 0;
+  uint64_t max_latency_ns = 0;
+  uint64_t rotate_ns = 0;
+  bool ok = true;
+
+  while (nreplies < count && ok) {
+    if (nsent < count && nsent - nreplies < MAX_IN_FLIGHT) {
+      struct rotated_request_s request = {
+          .magic = ROTATED_MAGIC,
+          .op = ROTATED_OP_ROTATE,
+          .id = nsent,
+          .N = N,
+          .offset = nsent * slot,
+          .priority = priority,
+      };
+      strncpy(request.kernel, kernel, ROTATED_KERNEL_NAME_LEN - 1);
+      sent[nsent] = gettime();
+      ok = send_request(sock, &request, fd);
+      nsent++;
+      continue;
+    }
+
+    struct rotated_reply_s reply;
+    ok = receive_reply(sock, &reply, NULL) && reply.id < nsent;
+    if (!ok) {
+      break;
+    }
+    nreplies++;
+    if (reply.status != ROTATED_OK) {
+      printf("Rotation %" PRIu64 ": %s\n", reply.id, status_name(reply.status));
+      nwrong++;
+      continue;
+    }
+
+    const uint64_t ns = tdiff_nsec(sent[reply.id], gettime());
+    latency_ns += ns;
+    max_latency_ns = ns > max_latency_ns ? ns : max_latency_ns;
+    rotate_ns += reply.rotate_ns;
+    if (!matrix_equal(slots + reply.id * slot, expected, nbytes, NULL)) {
+      printf("Rotation %" PRIu64 ": wrong result\n", reply.id);
+      nwrong++;
+    }
+  }
+
+  const uint32_t ndone = nreplies - nwrong;
+  printf("N=%zu: %u of %u rotations correct", N, ndone, count);
+  if (ndone) {
+    printf(", latency mean %.3f ms max %.3f ms, rotation mean %.3f ms",
+           latency_ns / 1e6 / ndone, max_latency_ns / 1e6,
+           rotate_ns / 1e6 / ndone);
+  }
+  printf("\n");
+
+  free(sent);
+  matrix_free(expected);
+  munmap(slots, slot * count);
+  close(fd);
+  return ok && !nwrong && nreplies == count;
+}
+
+static bool run_simple(const int sock, const enum rotated_op_e op) {
+  const struct rotated_request_s request = {.magic = ROTATED_MAGIC, .op = op};
+  struct rotated_reply_s reply;
+  struct rotated_stats_s stats;
+  if (!send_request(sock, &request, -1) ||
+      !receive_reply(sock, &reply, op == ROTATED_OP_STATS ? &stats : NULL)) {
+    return false;
+  }
+  if (op == ROTATED_OP_STATS) {
+    rotated_print_stats(stdout, &stats);
+  }
+  return reply.status == ROTATED_OK;
+}
+
+int main(int argc, char *argv[]) {
+  const char *path = ROTATED_DEFAULT_SOCKET;
+  bits_t N = 0;
+  long count = 1;
+  long priority = 0;
+  const char *kernel = "";
+  bool print_stats = false;
+  bool shutdown = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "hs:N:n:p:K:Sx")) != -1) {
+    switch (opt) {
+      case 's':  // Socket path
+        path = optarg;
+        break;
+
+      case 'N':  // Generated matrix dimension
+        N = (bits_t)atol(optarg);
+        if (N < 64 || N % 64 != 0) {
+          printf("Invalid Dimension: Dimension MUST be a multiple of 64!\n");
+          goto help;
+        }
+        break;
+
+      case 'n':  // Rotations
+        count = atol(optarg);
+        if (count <= 0 || count > UINT32_MAX) {
+          printf("Invalid count: MUST be a positive integer\n");
+          goto help;
+        }
+        break;
+
+      case 'p':  // Priority
+        priority = atol(optarg);
+        if (priority < 0 || priority >= ROTATED_NPRIORITIES) {
+          printf("Invalid priority: MUST be 0 to %d\n", ROTATED_NPRIORITIES - 1);
+          goto help;
+        }
+        break;
+
+      case 'K':  // Kernel of the daemon
+        kernel = optarg;
+        break;
+
+      case 'S':  // Stats of the daemon
+        print_stats = true;
+        break;
+
+      case 'x':  // Shut the daemon down
+        shutdown = true;
+        break;
+
+      default:
+        goto help;
+    }
+  }
+  if (optind < argc || (!N && !print_stats && !shutdown)) {
+    goto help;
+  }
+
+  const int sock = connect_to(path);
+  if (sock < 0) {
+    return 1;
+  }
+
+  bool ok = true;
+  if (N) {
+    ok = run_rotations(sock, N, count, priority, kernel) && ok;
+  }
+  if (print_stats) {
+    ok = run_simple(sock, ROTATED_OP_STATS) && ok;
+  }
+  if (shutdown) {
+    ok = run_simple(sock, ROTATED_OP_SHUTDOWN) && ok;
+  }
+  close(sock);
+  return ok ? 0 : 1;
+
+help:
+  printf(
+      "Usage: %s [-s socket] [-N size [-n count] [-p priority] [-K kernel]] "
+      "[-S] [-x]\n"
+      "  -s  the socket of the daemon, %s by default\n"
+      "  -N  rotate a generated matrix of this size and check the result\n"
+      "  -n  rotate this many copies of it at once, 1 by default\n"
+      "  -p  the priority of the rotations, 0 (first) to %d, 0 by default\n"
+      "  -K  the kernel, the daemon's default if not given\n"
+      "  -S  print the stats of the daemon\n"
+      "  -x  shut the daemon down once its queued rotations are done\n",
+      argv[0], ROTATED_DEFAULT_SOCKET, ROTATED_NPRIORITIES - 1);
+  return 1;
+}
@@ -0,0 +1,90 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#include "rotated.h"
+
+#include <inttypes.h>
+
+
+// The width of the longest bar of a histogram
+#define HIST_BAR 40
+
+// The bucket of `value`, see ROTATED_HIST_BUCKETS
+uint32_t rotated_hist_bucket(const uint64_t value) {
+  if (!value) {
+    return 0;
+  }
+  const uint32_t bucket = 64 - __builtin_clzll(value);
+  return bucket < ROTATED_HIST_BUCKETS ? bucket : ROTATED_HIST_BUCKETS - 1;
+}
+
+// Prints the non-empty buckets of `hist`, one per line with a bar
+static void print_hist(FILE *f, const char *title, const uint64_t hist[]) {
+  uint64_t peak = 0;
+  for (uint32_t b = 0; b < ROTATED_HIST_BUCKETS; b++) {
+    peak = hist[b] > peak ? hist[b] : peak;
+  }
+
+  fprintf(f, "%s\n", title);
+  if (!peak) {
+    fprintf(f, "  (none)\n");
+    return;
+  }
+
+  for (uint32_t b = 0; b < ROTATED_HIST_BUCKETS; b++) {
+    if (!hist[b]) {
+      continue;
+    }
+    char range[48];
+    if (b <= 1) {
+      snprintf(range, sizeof(range), "%u", b);
+    } else if (b == ROTATED_HIST_BUCKETS - 1) {
+      snprintf(range, sizeof(range), ">= %" PRIu64, (uint64_t)1 << (b - 1));
+    } else {
+      snprintf(range, sizeof(range), "%" PRIu64 "-%" PRIu64,
+               (uint64_t)1 << (b - 1), ((uint64_t)1 << b) - 1);
+    }
+
+    const int bar = (int)((hist[b] * HIST_BAR + peak - 1) / peak);
+    fprintf(f, "  %21s %10" PRIu64 " %.*s\n", range, hist[b], bar,
+            "########################################");
+  }
+}
+
+void rotated_print_stats(FILE *f, const struct rotated_stats_s *stats) {
+  fprintf(f,
+          "requests: %" PRIu64 " received, %" PRIu64 " completed, %" PRIu64
+          " rejected\n",
+          stats->received, stats->completed, stats->rejected);
+  fprintf(f, "queue: %u waiting (", stats->queue_depth);
+  for (uint32_t p = 0; p < ROTATED_NPRIORITIES; p++) {
+    fprintf(f, "%sp%u %u", p ? ", " : "", p, stats->queued[p]);
+  }
+  fprintf(f, "), at most %u, %u workers\n", stats->max_queue_depth,
+          stats->nworkers);
+
+  print_hist(f, "queue depth on arrival:", stats->depth_hist);
+  print_hist(f, "queued (us):", stats->queue_us_hist);
+  print_hist(f, "rotating (us):", stats->rotate_us_hist);
+  print_hist(f, "receipt to reply (us):", stats->latency_us_hist);
+}
@@ -81,7 +81,7 @@ static inline uint64_t tdiff_msec(const fasttime_t start,
 static inline uint64_t tdiff_usec(const fasttime_t start,
                                   const fasttime_t stop) {
   return 1000000 * (stop.tv_sec - start.tv_sec) +
-         (stop.tv_nsec - start.tv_nsec) / 1000000;
+         (stop.tv_nsec - start.tv_nsec) / 1000;
 }
 
 static inline uint64_t tdiff_nsec(const fasttime_t start,
@@ -101,4 +101,14 @@ time_t time(time_t *) __attribute__((deprecated));
 
 #endif  // LINUX
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>  // __rdtsc
+
+// Return the time stamp counter, which ticks at a constant rate on every
+// machine we run on. Returns 0 where there is no such counter.
+static inline uint64_t getcycles(void) { return __rdtsc(); }
+#else
+static inline uint64_t getcycles(void) { return 0; }
+#endif
+
 #endif  // INCLUDED_FASTTIME_DOT_H
@@ -0,0 +1,235 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#include "./fingerprint.h"
+
+#include <string.h>
+
+#include "./parallel.h"
+
+// The matrix is swept in bands of 8 rows, which are split between threads.
+// Every thread XORs its column fingerprints into its own array, and the
+// arrays are merged once all bands are done
+#define FINGERPRINT_BANDS_PER_CHUNK 4
+
+struct fingerprint_pass_s {
+  const struct fingerprint_s *fp;
+  const uint8_t *bit_matrix;
+
+  // Looks up the row fingerprints with the keys reversed, for output rows
+  bool reversed_rows;
+
+  uint64_t *rows;
+  uint64_t *cols;  // one array of N per worker
+};
+
+// SplitMix64, to derive the keys from the seed
+static uint64_t splitmix64(uint64_t *state) {
+  uint64_t z = (*state += 0x9E3779B97F4A7C15);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+  return z ^ (z >> 31);
+}
+
+// Returns the XOR of the keys of the set bits of the byte `v` at byte
+// position `p` of a line
+static inline uint64_t lookup_byte(const uint64_t *tables, const bytes_t p,
+                                   const uint8_t v) {
+  return tables[32 * p + (v >> 4)] ^ tables[32 * p + 16 + (v & 0xF)];
+}
+
+static inline uint8_t reverse_byte(uint8_t v) {
+  v = (v & 0xF0) >> 4 | (v & 0x0F) << 4;
+  v = (v & 0xCC) >> 2 | (v & 0x33) << 2;
+  v = (v & 0xAA) >> 1 | (v & 0x55) << 1;
+  return v;
+}
+
+// Sets up empty fingerprints of an `N` by `N` bit matrix with keys drawn from
+// `seed`.
+//
+// Returns `false` if there was an error
+bool fingerprint_init(struct fingerprint_s *fp, const bits_t N,
+                      const uint64_t seed) {
+  assert(N > 0);
+  assert(!(N % 64));
+
+  fp->N = N;
+  fp->tables = aligned_alloc(64, N / 4 * 16 * sizeof(uint64_t));
+  fp->rows = calloc(N, sizeof(uint64_t));
+  fp->cols = calloc(N, sizeof(uint64_t));
+  if (!fp->tables || !fp->rows || !fp->cols) {
+    fingerprint_free(fp);
+    return false;
+  }
+
+  // Bit 3 of a nibble is its first position, like bit 7 of a byte in
+  // `get_bit`. Every entry adds one key to an entry with one bit less
+  uint64_t state = seed;
+  for (bits_t q = 0; q < N / 4; q++) {
+    uint64_t *table = &fp->tables[16 * q];
+    uint64_t keys[4];
+    for (int k = 0; k < 4; k++) {
+      keys[k] = splitmix64(&state);
+    }
+
+    table[0] = 0;
+    for (int v = 1; v < 16; v++) {
+      const int bit = __builtin_ctz(v);
+      table[v] = table[v & (v - 1)] ^ keys[3 - bit];
+    }
+  }
+
+  return true;
+}
+
+void fingerprint_free(struct fingerprint_s *fp) {
+  free(fp->tables);
+  free(fp->rows);
+  free(fp->cols);
+  fp->tables = fp->rows = fp->cols = NULL;
+}
+
+// Fingerprints the bands of 8 rows [`begin`, `end`). Each 8 by 8 tile is
+// transposed so that its 8 columns are bytes too, and both are looked up in
+// the tables of their byte positions
+static void fingerprint_bands(const uint64_t begin, const uint64_t end,
+                              const uint32_t worker, void *arg) {
+  const struct fingerprint_pass_s *pass = arg;
+  const bits_t N = pass->fp->N;
+  const bytes_t row_size = bits_to_bytes(N);
+  const uint64_t *const tables = pass->fp->tables;
+  uint64_t *const cols = &pass->cols[worker * N];
+
+  for (uint64_t band = begin; band < end; band++) {
+    const uint8_t *const rows = pass->bit_matrix + 8 * band * row_size;
+    uint64_t row_fps[8] = {0};
+
+    for (bytes_t p = 0; p < row_size; p++) {
+      uint64_t tile = 0;
+      for (int k = 0; k < 8; k++) {
+        const uint8_t v = rows[k * row_size + p];
+        tile = (tile << 8) | v;
+
+        if (pass->reversed_rows) {
+          row_fps[k] ^= lookup_byte(tables, row_size - 1 - p, reverse_byte(v));
+        } else {
+          row_fps[k] ^= lookup_byte(tables, p, v);
+        }
+      }
+
+      // Byte 7 - k of the transposed tile is column 8 * p + k, with the bit
+      // of row 8 * band first
+      tile = transpose_tile_8(tile);
+      for (int k = 0; k < 8; k++) {
+        cols[8 * p + k] ^= lookup_byte(tables, band, tile >> (56 - 8 * k));
+      }
+    }
+
+    memcpy(&pass->rows[8 * band], row_fps, sizeof(row_fps));
+  }
+}
+
+// Runs one pass of `fingerprint_bands` over `bit_matrix` into `rows` and
+// `cols`.
+//
+// Returns `false` if there was an error
+static bool fingerprint_pass(const struct fingerprint_s *fp,
+                             const uint8_t *bit_matrix,
+                             const bool reversed_rows, uint64_t *rows,
+                             uint64_t *cols) {
+  const bits_t N = fp->N;
+  const uint32_t nworkers = parallel_nthreads();
+
+  struct fingerprint_pass_s pass = {
+      .fp = fp,
+      .bit_matrix = bit_matrix,
+      .reversed_rows = reversed_rows,
+      .rows = rows,
+      .cols = calloc((size_t)nworkers * N, sizeof(uint64_t)),
+  };
+  if (!pass.cols) {
+    return false;
+  }
+
+  parallel_for_placed(N / 8, FINGERPRINT_BANDS_PER_CHUNK, NUMA_MIRRORED,
+                      fingerprint_bands, &pass);
+
+  memset(cols, 0, N * sizeof(uint64_t));
+  for (uint32_t w = 0; w < nworkers; w++) {
+    for (bits_t x = 0; x < N; x++) {
+      cols[x] ^= pass.cols[w * N + x];
+    }
+  }
+
+  free(pass.cols);
+  return true;
+}
+
+// Fingerprints the rows and columns of the input `bit_matrix` in one pass
+void fingerprint_input(struct fingerprint_s *fp, const uint8_t *bit_matrix) {
+  if (!fingerprint_pass(fp, bit_matrix, false, fp->rows, fp->cols)) {
+    printf("Error: Run out of heap space! Please try smaller matrix size.\n");
+    assert(false);
+  }
+}
+
+// Checks that `rotated` is the input fingerprinted by `fingerprint_input`
+// rotated clockwise 90 degrees, in one pass over it. If `mismatch` is not
+// NULL, saves where they disagree in it.
+//
+// Returns `true` if every row and column matches
+bool fingerprint_check_rotated(const struct fingerprint_s *fp,
+                               const uint8_t *rotated,
+                               struct fingerprint_mismatch_s *mismatch) {
+  const bits_t N = fp->N;
+  uint64_t *rows = malloc(N * sizeof(uint64_t));
+  uint64_t *cols = malloc(N * sizeof(uint64_t));
+  if (!rows || !cols ||
+      !fingerprint_pass(fp, rotated, true, rows, cols)) {
+    printf("Error: Run out of heap space! Please try smaller matrix size.\n");
+    assert(false);
+  }
+
+  struct fingerprint_mismatch_s m = {0, 0, N, N};
+  for (bits_t y = 0; y < N; y++) {
+    // Output row y is input column y read from the bottom up
+    if (rows[y] != fp->cols[y] && !m.nrows++) {
+      m.first_row = y;
+    }
+  }
+  for (bits_t x = 0; x < N; x++) {
+    // Output column x is input row N - 1 - x
+    if (cols[x] != fp->rows[N - 1 - x] && !m.ncols++) {
+      m.first_col = x;
+    }
+  }
+
+  free(rows);
+  free(cols);
+
+  if (mismatch) {
+    *mismatch = m;
+  }
+  return !m.nrows && !m.ncols;
+}
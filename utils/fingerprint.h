@@ -0,0 +1,72 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#ifndef FINGERPRINT_H
+#define FINGERPRINT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "./utils.h"
+
+// Row and column fingerprints of an N by N bit matrix, to check a rotation
+// without a second copy of the matrix. Uses O(N) memory.
+//
+// The fingerprint of a line of bits is the XOR of the random keys of the
+// positions of its set bits, so it is linear over GF(2) and any wrong line
+// is caught unless its wrong bits happen to have keys that XOR to 0.
+// Rotating clockwise turns input row y into output column N - 1 - y, and
+// input column x into output row x read from the bottom up, so the output
+// fingerprints are checked against the input ones with the keys reversed
+// along the output rows
+struct fingerprint_s {
+  bits_t N;
+
+  // The XOR of the keys of the set bits of every nibble value at every
+  // nibble position of a line, N / 4 tables of 16 entries
+  uint64_t *tables;
+
+  uint64_t *rows;
+  uint64_t *cols;
+};
+
+// Where a rotated matrix disagrees with the fingerprints
+struct fingerprint_mismatch_s {
+  uint64_t nrows;     // output rows with a wrong fingerprint
+  uint64_t ncols;     // output columns with a wrong fingerprint
+  uint64_t first_row;
+  uint64_t first_col;
+};
+
+bool fingerprint_init(struct fingerprint_s *fp, const bits_t N,
+                      const uint64_t seed);
+
+void fingerprint_free(struct fingerprint_s *fp);
+
+void fingerprint_input(struct fingerprint_s *fp, const uint8_t *bit_matrix);
+
+bool fingerprint_check_rotated(const struct fingerprint_s *fp,
+                               const uint8_t *rotated,
+                               struct fingerprint_mismatch_s *mismatch);
+
+#endif  // FINGERPRINT_H
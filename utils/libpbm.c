@@ -0,0 +1,270 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#include "./libpbm.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The raster is used in place only if it starts on a 64-byte boundary of the
+// mapping, which matches the alignment of the buffers from `aligned_alloc`
+#define PBM_DATA_ALIGNMENT 64
+
+static bool is_pbm_space(uint8_t c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' ||
+         c == '\r';
+}
+
+// Skips whitespace and `#` comments starting at `*pos`
+static void skip_space_and_comments(const uint8_t *buf, size_t size,
+                                    size_t *pos) {
+  while (*pos < size) {
+    if (buf[*pos] == '#') {
+      while (*pos < size && buf[*pos] != '\n') {
+        (*pos)++;
+      }
+    } else if (is_pbm_space(buf[*pos])) {
+      (*pos)++;
+    } else {
+      return;
+    }
+  }
+}
+
+// Parses the decimal integer at `*pos`. Returns false if there is none
+static bool read_pbm_int(const uint8_t *buf, size_t size, size_t *pos,
+                         int *value) {
+  skip_space_and_comments(buf, size, pos);
+
+  if (*pos >= size || buf[*pos] < '0' || buf[*pos] > '9') {
+    return false;
+  }
+
+  int64_t v = 0;
+  while (*pos < size && buf[*pos] >= '0' && buf[*pos] <= '9') {
+    v = 10 * v + (buf[*pos] - '0');
+    if (v > INT32_MAX) {
+      return false;
+    }
+    (*pos)++;
+  }
+
+  *value = (int)v;
+  return true;
+}
+
+// Parses the P4 header in `buf` and saves the dimensions in `_w` and `_h`
+// and the offset of the raster in `_data_offset`
+static bool read_pbm_header(const uint8_t *buf, size_t size, int *_w, int *_h,
+                            size_t *_data_offset) {
+  // The magic number "P4" for binary bitmap files
+  if (size < 2 || buf[0] != 'P' || buf[1] != '4') {
+    return false;
+  }
+
+  size_t pos = 2;
+  if (!read_pbm_int(buf, size, &pos, _w) ||
+      !read_pbm_int(buf, size, &pos, _h)) {
+    return false;
+  }
+
+  // Exactly one whitespace character separates the header from the raster
+  if (pos >= size || !is_pbm_space(buf[pos])) {
+    return false;
+  }
+
+  *_data_offset = pos + 1;
+  return true;
+}
+
+// Returns `true` if `fname` starts with the P4 magic number
+bool is_binary_pbm(const char *fname) {
+  FILE *f = fopen(fname, "rb");
+  if (!f) {
+    return false;
+  }
+
+  char magic[2];
+  bool ret = fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+             magic[0] == 'P' && magic[1] == '4';
+
+  fclose(f);
+  return ret;
+}
+
+// Reads the binary image from `fname` into `image`.
+//
+// The file is mapped privately, so if the raster is suitably aligned (which
+// is always the case for files written by `write_binary_pbm`) `image->data`
+// points straight into the mapping and pages are only faulted in as the
+// rotation touches them. Writes to the image are copy-on-write and never
+// reach the file. Otherwise the raster is copied into an aligned buffer.
+//
+// Returns `false` if there was an error. Release `image` with
+// `free_binary_pbm`
+bool read_binary_pbm(const char *fname, struct pbm_image_s *image) {
+  assert(image);
+
+  int fd = open(fname, O_RDONLY);
+
+  // There was some sort of error
+  if (fd < 0) {
+    perror("Error reading PBM file");
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) || st.st_size <= 0) {
+    perror("Error reading PBM file");
+    close(fd);
+    return false;
+  }
+
+  const size_t map_size = st.st_size;
+  uint8_t *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                      fd, 0);
+
+  // The mapping keeps its own reference to the file
+  close(fd);
+
+  if (map == MAP_FAILED) {
+    perror("Error mapping PBM file");
+    return false;
+  }
+
+  int width, height;
+  size_t data_offset;
+  if (!read_pbm_header(map, map_size, &width, &height, &data_offset) ||
+      width <= 0 || height <= 0) {
+    fprintf(stderr, "Error reading PBM headers: %s is not a P4 file\n", fname);
+    munmap(map, map_size);
+    return false;
+  }
+
+  // Rows are aligned on a 1-byte boundary
+  const int row_size = (width + 7) / 8;
+  const size_t image_size = (size_t)row_size * height;
+
+  if (map_size - data_offset < image_size) {
+    fprintf(stderr, "Error reading PBM file: %s is truncated\n", fname);
+    munmap(map, map_size);
+    return false;
+  }
+
+  image->width = width;
+  image->height = height;
+  image->row_size = row_size;
+
+  if (data_offset % PBM_DATA_ALIGNMENT == 0) {
+    // Zero-copy: rotate the raster right where it is mapped
+    image->data = map + data_offset;
+    image->map = map;
+    image->map_size = map_size;
+    return true;
+  }
+
+  image->data = aligned_alloc(64, image_size);
+  if (!image->data) {
+    printf("Error: Image size is too large to fit in heap space!\n");
+    assert(false);
+  }
+
+  memcpy(image->data, map + data_offset, image_size);
+  munmap(map, map_size);
+
+  image->map = NULL;
+  image->map_size = 0;
+  return true;
+}
+
+// Releases the image data read by `read_binary_pbm`
+void free_binary_pbm(struct pbm_image_s *image) {
+  assert(image);
+
+  if (image->map) {
+    munmap(image->map, image->map_size);
+  } else {
+    free(image->data);
+  }
+
+  image->data = NULL;
+  image->map = NULL;
+  image->map_size = 0;
+
+  return;
+}
+
+// Write the binary `image_data` encoding an image `N` by `N` bits to
+// `output_fname`.
+//
+// The header is padded with a comment so that the raster starts on a 64-byte
+// boundary, which lets `read_binary_pbm` load the file without a copy
+void write_binary_pbm(const char *output_fname, uint8_t *image_data,
+                      const uint32_t N) {
+  // For now, writes will only support 1-byte aligned images
+  assert(N > 0);
+  assert(!(N % 8));
+
+  // Create a file `output_fname` if necessary
+  FILE *f = fopen(output_fname, "wb+");
+
+  // There was some sort of error
+  if (!f) {
+    perror("Error writing PBM file");
+    return;
+  }
+
+  char dimensions[32];
+  const int ndimensions = snprintf(dimensions, sizeof(dimensions), "%u %u\n",
+                                   N, N);
+
+  // "P4\n" + "#" + padding + "\n" + dimensions
+  const size_t unpadded_size = 3 + 2 + ndimensions;
+  const size_t npad =
+      (PBM_DATA_ALIGNMENT - unpadded_size % PBM_DATA_ALIGNMENT) %
+      PBM_DATA_ALIGNMENT;
+
+  char padding[PBM_DATA_ALIGNMENT];
+  memset(padding, ' ', npad);
+
+  fputs("P4\n#", f);
+  fwrite(padding, 1, npad, f);
+  fputs("\n", f);
+  fputs(dimensions, f);
+
+  // The rows are stored top-down with no padding, so the `image_data` can be
+  // written in one go
+  const size_t row_size = N / 8;
+  fwrite(image_data, 1, row_size * N, f);
+
+  // Close the file once finished!
+  fclose(f);
+
+  return;
+}
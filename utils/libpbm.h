@@ -0,0 +1,56 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#ifndef LIBPBM_H
+#define LIBPBM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Netpbm binary bitmap (P4) standard read from:
+//  https://netpbm.sourceforge.net/doc/pbm.html
+//
+// P4 stores rows top-down, MSB-first and byte-packed without any row
+// alignment, which is the same layout `get_bit`/`set_bit` use.
+struct pbm_image_s {
+  uint8_t *data;
+  int width;
+  int height;
+  int row_size;
+
+  // If `map` is not NULL, `data` points into a private file mapping of
+  // `map_size` bytes instead of a heap buffer
+  void *map;
+  size_t map_size;
+};
+
+bool is_binary_pbm(const char *fname);
+
+bool read_binary_pbm(const char *fname, struct pbm_image_s *image);
+
+void free_binary_pbm(struct pbm_image_s *image);
+
+void write_binary_pbm(const char *output_fname, uint8_t *image_data,
+                      const uint32_t N);
+
+#endif  // LIBPBM_H
@@ -0,0 +1,177 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#include "./machine.h"
+#include "./numa.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// A common second level TLB size on the x86-64 machines we run on
+#define ASSUMED_TLB_ENTRIES 1536
+
+// Reads a size like "48K" or "2048K" from the sysfs file `fname`
+static uint64_t read_sysfs_size(const char *fname) {
+  FILE *f = fopen(fname, "r");
+  if (!f) {
+    return 0;
+  }
+
+  uint64_t size = 0;
+  char unit = 0;
+  if (fscanf(f, "%" SCNu64 "%c", &size, &unit) >= 1) {
+    if (unit == 'K') {
+      size <<= 10;
+    } else if (unit == 'M') {
+      size <<= 20;
+    }
+  }
+
+  fclose(f);
+  return size;
+}
+
+// Falls back to sysfs for the cache of `level` when sysconf does not know it
+static uint64_t sysfs_cache_size(int level, bool data) {
+  for (int index = 0; index < 8; index++) {
+    char fname[128];
+    snprintf(fname, sizeof(fname),
+             "/sys/devices/system/cpu/cpu0/cache/index%d/level", index);
+
+    FILE *f = fopen(fname, "r");
+    if (!f) {
+      break;
+    }
+    int this_level = 0;
+    int ret = fscanf(f, "%d", &this_level);
+    fclose(f);
+    if (ret != 1 || this_level != level) {
+      continue;
+    }
+
+    char type[32] = "";
+    snprintf(fname, sizeof(fname),
+             "/sys/devices/system/cpu/cpu0/cache/index%d/type", index);
+    f = fopen(fname, "r");
+    if (f) {
+      ret = fscanf(f, "%31s", type);
+      fclose(f);
+    }
+    if (data && !strcmp(type, "Instruction")) {
+      continue;
+    }
+
+    snprintf(fname, sizeof(fname),
+             "/sys/devices/system/cpu/cpu0/cache/index%d/size", index);
+    return read_sysfs_size(fname);
+  }
+
+  return 0;
+}
+
+static uint64_t cache_size(int sysconf_name, int level) {
+  long size = sysconf(sysconf_name);
+  return size > 0 ? (uint64_t)size : sysfs_cache_size(level, true);
+}
+
+// Detects the data cache sizes and the TLB reach of the machine
+void detect_caches(struct cache_info_s *info) {
+  info->l1d_size = cache_size(_SC_LEVEL1_DCACHE_SIZE, 1);
+  info->l2_size = cache_size(_SC_LEVEL2_CACHE_SIZE, 2);
+  info->l3_size = cache_size(_SC_LEVEL3_CACHE_SIZE, 3);
+  info->page_size = sysconf(_SC_PAGESIZE);
+
+  // Some CPUs report their TLB size as "TLB size : 3072 4K pages"
+  uint64_t entries = 0;
+  FILE *f = fopen("/proc/cpuinfo", "r");
+  if (f) {
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+      if (!strncmp(line, "TLB size", 8)) {
+        const char *colon = strchr(line, ':');
+        if (colon) {
+          entries = strtoull(colon + 1, NULL, 10);
+        }
+        break;
+      }
+    }
+    fclose(f);
+  }
+
+  info->tlb_reach_assumed = entries == 0;
+  if (info->tlb_reach_assumed) {
+    entries = ASSUMED_TLB_ENTRIES;
+  }
+  info->tlb_reach = entries * info->page_size;
+}
+
+// Saves the CPU model name from /proc/cpuinfo in `model`, or "unknown"
+void detect_cpu_model(char *model, const size_t size) {
+  snprintf(model, size, "unknown");
+
+  FILE *f = fopen("/proc/cpuinfo", "r");
+  if (!f) {
+    return;
+  }
+
+  char line[256];
+  while (fgets(line, sizeof(line), f)) {
+    if (!strncmp(line, "model name", 10)) {
+      const char *colon = strchr(line, ':');
+      if (colon) {
+        snprintf(model, size, "%s", colon + 1 + (colon[1] == ' '));
+        model[strcspn(model, "\n")] = '\0';
+      }
+      break;
+    }
+  }
+  fclose(f);
+}
+
+struct smt_sibling_s {
+  uint32_t cpu;
+  int sibling;
+};
+
+// Keeps the first CPU of the siblings list other than the CPU itself
+static void add_smt_sibling(uint32_t cpu, void *arg) {
+  struct smt_sibling_s *sibling = arg;
+  if (cpu != sibling->cpu && sibling->sibling < 0) {
+    sibling->sibling = cpu;
+  }
+}
+
+// Returns the first hyperthread that shares a core with `cpu`, or -1 if it
+// has none or the topology is not reported
+int detect_smt_sibling(const int cpu) {
+  char fname[128];
+  snprintf(fname, sizeof(fname),
+           "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+  // The list is like "3,67" or "2-3"
+  struct smt_sibling_s sibling = {.cpu = cpu, .sibling = -1};
+  read_sysfs_list(fname, add_smt_sibling, &sibling);
+  return sibling.sibling;
+}
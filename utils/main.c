@@ -19,15 +19,36 @@
  * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
  * IN THE SOFTWARE.
  **/
+#include <inttypes.h>  // For `PRIu64`
 #include <limits.h>  // For `INT_MAX`, `INT_MIN`
 #include <string.h>  // For `strcmp`
 #include <unistd.h>  // For `getopt`
 
+#include "./parallel.h"
 #include "./tester.h"
+#include "./trace.h"
 #include "./utils.h"
+#include "./fasttime.h"
 
 extern void rotate_bit_matrix(uint8_t *img, const bits_t N);
 
+// The rotations that can be selected with -K, from librotate
+extern rotate_fn_t rotate_find_kernel(const char *name);
+extern const char *rotate_kernel_name(size_t index);
+
+// The Chrome trace is written on exit, including on the tier timeout
+static const char *trace_fname = NULL;
+
+static void write_trace(void) { trace_write_json(trace_fname); }
+
+#ifdef ROTATE_PROFILE
+// Built with `make PROFILE=1`: the per-phase profile of the rotation is
+// printed when the program exits, including on the tier timeout
+extern void rotate_profile_dump(FILE *f);
+
+static void print_rotate_profile(void) { rotate_profile_dump(stdout); }
+#endif
+
 const uint32_t TIER_TIMEOUT = 1000;
 const uint32_t TIMEOUT = 58000;
 const bits_t START_SIZE = 26624;
@@ -37,6 +58,18 @@ const int MAX_TIER_ALLOW = MAX_TIER;
 const int DEFAULT_MAX_TIER = 25;
 const int DEFAULT_LINEAR_TIERS = 8;
 const unsigned DEFAULT_BLOWTHROUGHS = 2;
+const bits_t DEFAULT_SWEEP_MAX = 32768;
+const bits_t DEFAULT_CORRECTNESS_MAX = 9984;
+const bits_t DEFAULT_API_MAX = 2496;
+
+// The benchmark suite times more runs than the other tests by default, and
+// flags cases that are more than 5% slower than the baseline
+const int DEFAULT_SUITE_WARMUP = 2;
+const int DEFAULT_SUITE_REPS = 11;
+const double SUITE_THRESHOLD = 0.05;
+
+// The trace keeps the last 1M events of every thread
+const uint32_t TRACE_EVENTS_PER_THREAD = 1 << 20;
 
 #define SET_UNUSED(v) (void)v;
 
@@ -48,7 +81,11 @@ int main(int argc, char *argv[]) {
     TEST_FILE,
     TEST_GENERATED,
     TEST_CORRECTNESS,
-    TEST_TIERS
+    TEST_TIERS,
+    TEST_SWEEP,
+    TEST_SUITE,
+    TEST_VERIFY,
+    TEST_API
   };
   enum test_type_e test_type = TEST_NOT_SET;
 
@@ -66,13 +103,33 @@ int main(int argc, char *argv[]) {
   int linear_tiers = DEFAULT_LINEAR_TIERS;
   unsigned blowthroughs = DEFAULT_BLOWTHROUGHS;
 
+  // The flags for a `TEST_SUITE` test type
+  char *baseline_fname = NULL;
+
+  // The flags for the generated bit matrices
+  bool seed_set = false;
+  uint64_t seed = 0;
+  enum generate_profile_e profile = GENERATE_RANDOM;
+
+  // The timing flags for every test type
+  int warmup = -1;
+  int reps = 0;
+  bool cycles = false;
+
+  // The rotation under test
+  rotate_fn_t rotate_fn = rotate_bit_matrix;
+
   // If the program was called without arguments, this is malformed input
   if (argc == 1) {
     goto help;
   }
 
+#ifdef ROTATE_PROFILE
+  atexit(print_rotate_profile);
+#endif
+
   // Parse the CLI input!
-  while ((opt = getopt(argc, argv, "ht:f:o:N:s:m:l:M:x")) != -1) {
+  while ((opt = getopt(argc, argv, "ht:f:o:N:s:m:l:M:xr:w:cP:b:T:S:g:j:K:")) != -1) {
     switch (opt) {
       case 'h':  // Help
         goto help;
@@ -105,7 +162,6 @@ int main(int argc, char *argv[]) {
           // The fields that should be unused
           SET_UNUSED(fname);
           SET_UNUSED(output_fname);
-          SET_UNUSED(N);
           SET_UNUSED(max_tier);
 
         } else if (!strcmp("tiers", optarg)) {
@@ -116,6 +172,38 @@ int main(int argc, char *argv[]) {
           SET_UNUSED(output_fname);
           SET_UNUSED(N);
 
+        } else if (!strcmp("sweep", optarg)) {
+          test_type = TEST_SWEEP;
+
+          // The fields that should be unused
+          SET_UNUSED(fname);
+          SET_UNUSED(output_fname);
+          SET_UNUSED(max_tier);
+
+        } else if (!strcmp("verify", optarg)) {
+          test_type = TEST_VERIFY;
+
+          // The fields that should be unused
+          SET_UNUSED(fname);
+          SET_UNUSED(output_fname);
+          SET_UNUSED(max_tier);
+
+        } else if (!strcmp("api", optarg)) {
+          test_type = TEST_API;
+
+          // The fields that should be unused
+          SET_UNUSED(fname);
+          SET_UNUSED(output_fname);
+          SET_UNUSED(max_tier);
+
+        } else if (!strcmp("suite", optarg)) {
+          test_type = TEST_SUITE;
+
+          // The fields that should be unused
+          SET_UNUSED(fname);
+          SET_UNUSED(N);
+          SET_UNUSED(max_tier);
+
         } else {
           // Malformed input
           goto help;
@@ -218,6 +306,92 @@ int main(int argc, char *argv[]) {
         fail_faulty = true;
         break;
 
+      case 'r':  // Timed repetitions
+        reps = atoi(optarg);
+
+        if (reps <= 0 || reps == INT_MAX) {
+          printf("Invalid repetitions: MUST be a positive integer\n");
+          goto help;
+        }
+        break;
+
+      case 'w':  // Warmup runs
+        warmup = atoi(optarg);
+
+        if (warmup < 0 || warmup == INT_MAX) {
+          printf("Invalid warmup: MUST be a non-negative integer\n");
+          goto help;
+        }
+        break;
+
+      case 'c':  // Count TSC cycles
+        cycles = true;
+        break;
+
+      case 'b':  // Baseline results of the benchmark suite
+        // Make sure the input is fresh
+        if (baseline_fname != NULL) {
+          goto help;
+        }
+
+        baseline_fname = optarg;
+        break;
+
+      case 'S': {  // Seed of the generated bit matrices
+        char *end;
+        seed = strtoull(optarg, &end, 0);
+        if (*end || end == optarg) {
+          printf("Invalid seed: MUST be a non-negative integer\n");
+          goto help;
+        }
+        seed_set = true;
+        break;
+      }
+
+      case 'g':  // Profile of the generated bit matrices
+        if (!parse_generate_profile(optarg, &profile)) {
+          printf("Invalid profile: MUST be random, sparse or text\n");
+          goto help;
+        }
+        break;
+
+      case 'j': {  // Threads of the stock rotation and the test harness
+        const int nthreads = atoi(optarg);
+        if (nthreads <= 0) {
+          printf("Invalid threads: MUST be a positive integer\n");
+          goto help;
+        }
+        parallel_set_nthreads(nthreads);
+        break;
+      }
+
+      case 'K':  // Rotation under test
+        rotate_fn = rotate_find_kernel(optarg);
+        if (!rotate_fn) {
+          printf("Invalid kernel: MUST be one of");
+          for (size_t k = 0; rotate_kernel_name(k); k++) {
+            printf(" %s", rotate_kernel_name(k));
+          }
+          printf("\n");
+          goto help;
+        }
+        break;
+
+      case 'T':  // Chrome trace of the run
+        // Make sure the input is fresh
+        if (trace_fname != NULL) {
+          goto help;
+        }
+
+        trace_fname = optarg;
+        break;
+
+      case 'P':  // Hardware performance counters
+        if (!perf_counters_select(optarg)) {
+          goto help;
+        }
+        break;
+
       default:
         goto help;
     }
@@ -243,6 +417,28 @@ int main(int argc, char *argv[]) {
     goto help;
   }
 
+  // Unless they were given, the suite uses its own timing defaults
+  if (test_type == TEST_SUITE) {
+    warmup = warmup < 0 ? DEFAULT_SUITE_WARMUP : warmup;
+    reps = reps ? reps : DEFAULT_SUITE_REPS;
+  }
+  set_timing_options(warmup < 0 ? 0 : warmup, reps ? reps : 1, cycles);
+
+  // A run can be repeated on the same data with the seed printed here
+  if (!seed_set) {
+    seed = random_seed_from_clock();
+  }
+  if (test_type != TEST_FILE) {
+    printf("Generating bit matrices with seed %" PRIu64 "\n", seed);
+  }
+  set_generate_options(seed, profile);
+
+  if (trace_fname) {
+    trace_enable(TRACE_EVENTS_PER_THREAD);
+    trace_set_thread_name("main");
+    atexit(write_trace);
+  }
+
   // Execute the respective tester function based on the CLI input
   switch (test_type) {
     case TEST_FILE: {
@@ -253,11 +449,11 @@ int main(int argc, char *argv[]) {
 
       // Whether to disregard the output or not
       if (!output_fname) {
-        bool result = run_tester(fname, rotate_bit_matrix);
+        bool result = run_tester(fname, rotate_fn);
         printf("Result: %s\n", result ? PASS_STR : FAIL_STR);
       } else {
         bool result = run_tester_save_output(fname, output_fname,
-                                             rotate_bit_matrix, true);
+                                             rotate_fn, true);
         printf("Result: %s\n", result ? PASS_STR : FAIL_STR);
       }
 
@@ -269,7 +465,19 @@ int main(int argc, char *argv[]) {
         goto help;
       }
 
-      bool result = run_tester_generated_bit_matrix(rotate_bit_matrix, N);
+      bool result = run_tester_generated_bit_matrix(rotate_fn, N);
+
+      printf("Result: %s\n", result ? PASS_STR : FAIL_STR);
+
+      break;
+    }
+    case TEST_VERIFY: {
+      // The `N` is a required argument
+      if (N == 0) {
+        goto help;
+      }
+
+      bool result = run_tester_verify(rotate_fn, N);
 
       printf("Result: %s\n", result ? PASS_STR : FAIL_STR);
 
@@ -278,7 +486,9 @@ int main(int argc, char *argv[]) {
     case TEST_CORRECTNESS: {
       const bits_t START_SIZE = 64;
 
-      bool correctness = run_correctness_tester(rotate_bit_matrix, START_SIZE);
+      // The `N` is the largest dimension to test up to
+      bool correctness = run_correctness_tester(
+          rotate_fn, START_SIZE, N ? N : DEFAULT_CORRECTNESS_MAX);
       if (correctness)
         printf(PASS_STR ": Congrats! You pass all correctness tests\n");
       else
@@ -289,6 +499,16 @@ int main(int argc, char *argv[]) {
 
       break;
     }
+    case TEST_API: {
+      // The `N` is the largest dimension to test up to
+      bool result = run_api_tester(N ? N : DEFAULT_API_MAX);
+      printf("Result: %s\n", result ? PASS_STR : FAIL_STR);
+
+      if (fail_faulty)
+        assert(result);
+
+      break;
+    }
     case TEST_TIERS: {
       if (max_tier == -1) {
         max_tier = DEFAULT_MAX_TIER;
@@ -296,7 +516,7 @@ int main(int argc, char *argv[]) {
 
       printf("FYI: the max tier you can be graded on is %d.\n", MAX_TIER_ALLOW);
 
-      uint32_t tier = run_tester_tiers(rotate_bit_matrix, TIER_TIMEOUT, TIMEOUT,
+      uint32_t tier = run_tester_tiers(rotate_fn, TIER_TIMEOUT, TIMEOUT,
                                        START_SIZE, GROWTH_RATE, min_tier,
                                        max_tier, linear_tiers, blowthroughs);
 
@@ -309,6 +529,21 @@ int main(int argc, char *argv[]) {
 
       break;
     }
+    case TEST_SWEEP: {
+      // The `N` is the largest dimension to sweep up to
+      run_tester_sweep(rotate_fn, N ? N : DEFAULT_SWEEP_MAX);
+
+      break;
+    }
+    case TEST_SUITE: {
+      bool result = run_tester_suite(rotate_fn, START_SIZE,
+                                     GROWTH_RATE, output_fname, baseline_fname,
+                                     SUITE_THRESHOLD);
+
+      printf("Result: %s\n", result ? PASS_STR : FAIL_STR);
+
+      break;
+    }
     default:
       // If the `test_type` was not set, this is malformed input
       goto help;
@@ -324,16 +559,23 @@ help:
       "-t {file|generated|       \t Select a test type                    \t "
       "Required to select test type\n"
       "\t"
-      "    correctness|tiers}\n"
+      "    correctness|tiers|\n"
+      "\t"
+      "    sweep|suite|verify|\n"
+      "\t"
+      "    api}\n"
       "\t"
-      "-f file-name              \t Input file name                       \t "
+      "-f file-name              \t Input BMP or PBM (P4) file name      \t "
       "Required for \"file\" test type\n"
       "\t"
-      "-o output-file-name       \t Output file name                      \t "
-      "Optional for \"file\" test type\n"
+      "-o output-file-name       \t Output file name, same format as -f  \t "
+      "Optional for \"file\" test type. Results file for \"suite\", "
+      "default is bench-<git hash>.txt\n"
       "\t"
       "-N dimension              \t Generated image dimension             \t "
-      "Required for \"generated\" test type\n"
+      "Required for \"generated\" and \"verify\" test types. Largest dimension for "
+      "\"sweep\", default is %zu, \"correctness\", default is %zu, and "
+      "\"api\", default is %zu.\n"
       "\t"
       "-m min-tier               \t Minimum tier                          \t "
       "Optional for \"tiers\" test type. Default is 0.\n"
@@ -345,12 +587,52 @@ help:
       "-M max-tier               \t Maximum tier                          \t "
       "Optional for \"tiers\" test type. Default is %d. Maximum is %d.\n"
       "\t"
+      "-b baseline-file-name     \t Baseline results to compare against  \t "
+      "Optional for \"suite\" test type. Flags cases more than %.0f%% "
+      "slower.\n"
+      "\t"
       "-x                        \t Fail for incorrect                    \t "
-      "Optional for \"correctness\" test type. Fails with non-zero exit code "
+      "Optional for \"correctness\" and \"api\" test types. Fails with non-zero exit code "
       "if faulty.\n"
       "\t"
+      "-r repetitions            \t Timed runs of every rotation          \t "
+      "Optional for all test types. Default is 1, %d for \"suite\". Reports "
+      "min/median/p90/stddev when > 1.\n"
+      "\t"
+      "-w warmup                 \t Untimed runs before the timed runs    \t "
+      "Optional for all test types. Default is 0, %d for \"suite\".\n"
+      "\t"
+      "-c                        \t Count TSC cycles                      \t "
+      "Optional for all test types. Reports cycles per 64x64 block.\n"
+      "\t"
+      "-P counter,...            \t Hardware counters to report           \t "
+      "Optional for all test types. Any of cycles, instructions, "
+      "cache-misses, l1d-misses, dtlb-misses, branch-misses or all.\n"
+      "\t"
+      "-S seed                   \t Seed of the generated matrices        \t "
+      "Optional for all generating test types. Default is from the clock.\n"
+      "\t"
+      "-g {random|sparse|text}   \t Content of the generated matrices     \t "
+      "Optional for all generating test types. Default is random.\n"
+      "\t"
+      "-j threads                \t Threads of the stock rotation         \t "
+      "Optional for all test types. Default is one per CPU, pinned to "
+      "their NUMA nodes.\n"
+      "\t"
+      "-K {inline|helper|        \t Rotation under test                  \t "
+      "Optional for all test types. Default is inline, helper prefetches "
+      "from a thread on the sibling hyperthread, block128 and block256 "
+      "rotate in wider blocks.\n"
+      "\t"
+      "    block128|block256}\n"
+      "\t"
+      "-T trace-file-name        \t Chrome trace of the run               \t "
+      "Optional for all test types. Open it in ui.perfetto.dev.\n"
+      "\t"
       "-h                        \t This help message\n",
-      DEFAULT_LINEAR_TIERS, DEFAULT_MAX_TIER, MAX_TIER_ALLOW);
+      DEFAULT_SWEEP_MAX, DEFAULT_CORRECTNESS_MAX, DEFAULT_API_MAX, DEFAULT_LINEAR_TIERS, DEFAULT_MAX_TIER,
+      MAX_TIER_ALLOW, 100 * SUITE_THRESHOLD, DEFAULT_SUITE_REPS,
+      DEFAULT_SUITE_WARMUP);
 
   return 1;
 }
@@ -0,0 +1,138 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+
+#define _GNU_SOURCE  // For `cpu_set_t` and `pthread_setaffinity_np`
+#include "./numa.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// The nodes that have CPUs, from sysfs. Memory-only nodes are left out: pages
+// are placed by first touch, which only ever picks a node with CPUs
+static struct {
+  uint32_t nnodes;
+  cpu_set_t cpus[NUMA_MAX_NODES];
+} numa_topology;
+
+static pthread_once_t numa_once = PTHREAD_ONCE_INIT;
+
+// Parses a sysfs list like "0-3,8-11" or "3,67" from the file `fname` and
+// calls `add` on every number in it.
+//
+// Returns false if the file cannot be opened
+bool read_sysfs_list(const char *fname, void (*add)(uint32_t, void *),
+                     void *arg) {
+  FILE *f = fopen(fname, "r");
+  if (!f) {
+    return false;
+  }
+
+  unsigned first, last;
+  int ret;
+  while ((ret = fscanf(f, "%u-%u", &first, &last)) >= 1) {
+    if (ret == 1) {
+      last = first;
+    }
+    for (unsigned n = first; n <= last; n++) {
+      add(n, arg);
+    }
+    if (fgetc(f) != ',') {
+      break;
+    }
+  }
+
+  fclose(f);
+  return true;
+}
+
+static void add_cpu(uint32_t cpu, void *arg) {
+  if (cpu < CPU_SETSIZE) {
+    CPU_SET(cpu, (cpu_set_t *)arg);
+  }
+}
+
+static void add_node(uint32_t node, void *arg) {
+  if (numa_topology.nnodes == NUMA_MAX_NODES) {
+    return;
+  }
+
+  char fname[64];
+  snprintf(fname, sizeof(fname), "/sys/devices/system/node/node%u/cpulist",
+           node);
+  cpu_set_t *cpus = &numa_topology.cpus[numa_topology.nnodes];
+  CPU_ZERO(cpus);
+  if (read_sysfs_list(fname, add_cpu, cpus) && CPU_COUNT(cpus)) {
+    numa_topology.nnodes++;
+  }
+}
+
+static void detect_numa_topology(void) {
+  read_sysfs_list("/sys/devices/system/node/online", add_node, NULL);
+
+  // Without NUMA support in the kernel, the machine is one node
+  if (numa_topology.nnodes == 0) {
+    numa_topology.nnodes = 1;
+    CPU_ZERO(&numa_topology.cpus[0]);
+    sched_getaffinity(0, sizeof(cpu_set_t), &numa_topology.cpus[0]);
+  }
+}
+
+// Returns the number of NUMA nodes with CPUs, 1 on a machine without NUMA
+uint32_t numa_nnodes(void) {
+  pthread_once(&numa_once, detect_numa_topology);
+  return numa_topology.nnodes;
+}
+
+// Returns the node that worker `worker` of `nworkers` runs on. The workers
+// are split evenly, and in order, between the nodes
+uint32_t numa_worker_node(const uint32_t worker, const uint32_t nworkers) {
+  return (uint64_t)worker * numa_nnodes() / nworkers;
+}
+
+// Returns the node that owns band `band` of `nbands`, see
+// `enum numa_placement_e`
+uint32_t numa_band_node(const uint64_t band, const uint64_t nbands,
+                        const enum numa_placement_e placement) {
+  const uint32_t nnodes = numa_nnodes();
+  if (placement == NUMA_BLOCKED) {
+    return band * nnodes / nbands;
+  }
+
+  const uint64_t fold = band < nbands - 1 - band ? band : nbands - 1 - band;
+  return fold * nnodes / ((nbands + 1) / 2);
+}
+
+// Restricts the calling thread to the CPUs of `node`. The scheduler still
+// balances the thread between them.
+//
+// Returns `false` if the affinity could not be set
+bool numa_pin_thread(const uint32_t node) {
+  if (node >= numa_nnodes()) {
+    return false;
+  }
+  return !pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+                                 &numa_topology.cpus[node]);
+}
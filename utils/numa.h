@@ -0,0 +1,60 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define NUMA_MAX_NODES 64
+
+// How the pages of a buffer split into bands are spread over the NUMA nodes.
+// Every node owns a share of the bands, and the threads of a node work on the
+// bands it owns
+enum numa_placement_e {
+  // Node k owns the k-th of `numa_nnodes()` contiguous runs of bands
+  NUMA_BLOCKED,
+
+  // Band b and its mirror band nbands - 1 - b have the same owner, and the
+  // pairs are split into contiguous runs like `NUMA_BLOCKED`. The rows y and
+  // N - 1 - y of a bit matrix are then on the same node, so that two of the
+  // four tiles of every 4-cycle of a rotation are on the node of its first
+  // row
+  NUMA_MIRRORED
+};
+
+uint32_t numa_nnodes(void);
+
+uint32_t numa_worker_node(const uint32_t worker, const uint32_t nworkers);
+
+uint32_t numa_band_node(const uint64_t band, const uint64_t nbands,
+                        const enum numa_placement_e placement);
+
+bool numa_pin_thread(const uint32_t node);
+
+bool read_sysfs_list(const char *fname, void (*add)(uint32_t, void *),
+                     void *arg);
+
+#endif  // NUMA_H
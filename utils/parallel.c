@@ -0,0 +1,267 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#define _GNU_SOURCE  // For `pthread_getaffinity_np`
+#include "./parallel.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "./trace.h"
+
+#define PARALLEL_MAX_THREADS 256
+
+// 0 means one thread per online CPU
+static uint32_t parallel_requested_nthreads = 0;
+
+struct parallel_job_s {
+  uint64_t n;
+  uint64_t grain;
+  parallel_body_t body;
+  void *arg;
+
+  // The next index that has not been handed out
+  _Atomic uint64_t next;
+
+  // For `parallel_for_placed`: the workers are pinned to their nodes, and
+  // every node hands out the bands it owns by their position in its share
+  bool placed;
+  bool pinned;
+  enum numa_placement_e placement;
+  uint64_t nbands;
+  uint32_t nthreads;
+  _Atomic uint64_t node_next[NUMA_MAX_NODES];
+};
+
+struct parallel_worker_s {
+  struct parallel_job_s *job;
+  uint32_t worker;
+};
+
+// Sets the number of threads of every `parallel_for`. 0 means one thread per
+// online CPU, which is the default
+void parallel_set_nthreads(const uint32_t nthreads) {
+  parallel_requested_nthreads =
+      nthreads < PARALLEL_MAX_THREADS ? nthreads : PARALLEL_MAX_THREADS;
+}
+
+uint32_t parallel_nthreads(void) {
+  if (parallel_requested_nthreads) {
+    return parallel_requested_nthreads;
+  }
+
+  const long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (ncpus < 1) {
+    return 1;
+  }
+  return ncpus < PARALLEL_MAX_THREADS ? ncpus : PARALLEL_MAX_THREADS;
+}
+
+static void run_chunk(const struct parallel_job_s *job, const uint64_t begin,
+                      const uint32_t worker) {
+  const uint64_t end = begin + job->grain < job->n ? begin + job->grain
+                                                   : job->n;
+  const uint64_t trace_start = trace_enabled() ? trace_now() : 0;
+  job->body(begin, end, worker, job->arg);
+  trace_span(TRACE_CHUNK, "chunk", trace_start, begin, end);
+}
+
+// The first band whose owner is at least `node` in the share of the bands
+// [0, `nbands`) of `nnodes` nodes, see `numa_band_node`
+static uint64_t first_owned(const uint64_t nbands, const uint32_t node,
+                            const uint32_t nnodes) {
+  return (node * nbands + nnodes - 1) / nnodes;
+}
+
+// Returns the number of bands that `node` owns, and saves the first one, or
+// the first of its pairs of mirrored bands, in `first`
+static uint64_t owned_bands(const struct parallel_job_s *job,
+                            const uint32_t node, uint64_t *first) {
+  const uint32_t nnodes = numa_nnodes();
+  if (job->placement == NUMA_BLOCKED) {
+    *first = first_owned(job->nbands, node, nnodes);
+    return first_owned(job->nbands, node + 1, nnodes) - *first;
+  }
+
+  // The middle band of an odd number of bands is its own mirror
+  const uint64_t nfolds = (job->nbands + 1) / 2;
+  *first = first_owned(nfolds, node, nnodes);
+  const uint64_t last = first_owned(nfolds, node + 1, nnodes);
+  const bool middle = last == nfolds && last > *first && job->nbands % 2;
+  return 2 * (last - *first) - middle;
+}
+
+// Hands out the bands of the node of `worker`, then helps the other nodes
+// with theirs
+static void run_placed(struct parallel_job_s *job, const uint32_t worker) {
+  const uint32_t nnodes = numa_nnodes();
+  const uint32_t home = numa_worker_node(worker, job->nthreads);
+
+  for (uint32_t k = 0; k < nnodes; k++) {
+    const uint32_t node = (home + k) % nnodes;
+    uint64_t first;
+    const uint64_t count = owned_bands(job, node, &first);
+
+    for (;;) {
+      const uint64_t i = atomic_fetch_add_explicit(&job->node_next[node], 1,
+                                                   memory_order_relaxed);
+      if (i >= count) {
+        break;
+      }
+
+      uint64_t band = first + i;
+      if (job->placement == NUMA_MIRRORED) {
+        band = i % 2 ? job->nbands - 1 - (first + i / 2) : first + i / 2;
+      }
+      if (node != home) {
+        trace_instant(TRACE_STEAL, "steal", node, band);
+      }
+      run_chunk(job, band * job->grain, worker);
+    }
+  }
+}
+
+// Hands out chunks of `grain` indices until the job is done
+static void run_worker(struct parallel_job_s *job, const uint32_t worker) {
+  if (job->placed) {
+    run_placed(job, worker);
+    return;
+  }
+
+  for (;;) {
+    const uint64_t begin = atomic_fetch_add_explicit(&job->next, job->grain,
+                                                     memory_order_relaxed);
+    if (begin >= job->n) {
+      break;
+    }
+    run_chunk(job, begin, worker);
+  }
+}
+
+static void *parallel_worker(void *arg) {
+  const struct parallel_worker_s *self = arg;
+  struct parallel_job_s *job = self->job;
+
+  if (job->pinned) {
+    numa_pin_thread(numa_worker_node(self->worker, job->nthreads));
+  }
+  run_worker(job, self->worker);
+
+  return NULL;
+}
+
+// Runs `job` on up to `parallel_nthreads()` threads
+static void parallel_run(struct parallel_job_s *job) {
+  // Do not start threads that would find no work
+  const uint64_t nchunks = (job->n + job->grain - 1) / job->grain;
+  uint32_t nthreads = parallel_nthreads();
+  if (nthreads > nchunks) {
+    nthreads = nchunks ? nchunks : 1;
+  }
+  job->nthreads = nthreads;
+
+  pthread_t threads[PARALLEL_MAX_THREADS];
+  struct parallel_worker_s workers[PARALLEL_MAX_THREADS];
+  uint32_t nstarted = 1;
+
+  for (uint32_t t = 1; t < nthreads; t++) {
+    workers[nstarted] = (struct parallel_worker_s){.job = job, .worker = t};
+    if (pthread_create(&threads[nstarted], NULL, parallel_worker,
+                       &workers[nstarted])) {
+      break;
+    }
+    nstarted++;
+  }
+
+  // The calling thread goes back to its own CPUs afterwards
+  cpu_set_t caller_cpus;
+  const bool restore = job->pinned &&
+                       !pthread_getaffinity_np(pthread_self(),
+                                               sizeof(cpu_set_t), &caller_cpus);
+
+  workers[0] = (struct parallel_worker_s){.job = job, .worker = 0};
+  parallel_worker(&workers[0]);
+
+  if (restore) {
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &caller_cpus);
+  }
+
+  for (uint32_t t = 1; t < nstarted; t++) {
+    pthread_join(threads[t], NULL);
+  }
+}
+
+// Calls `body` on chunks of at most `grain` of the indices [0, `n`) from
+// `parallel_nthreads()` threads, and returns once all of them are done. The
+// calling thread is worker 0. Chunks are handed out dynamically, so uneven
+// chunks balance out.
+//
+// If a thread cannot be started, the remaining work is done by the others
+void parallel_for(const uint64_t n, const uint64_t grain,
+                  const parallel_body_t body, void *arg) {
+  assert(grain > 0);
+  assert(body);
+
+  struct parallel_job_s job = {
+      .n = n, .grain = grain, .body = body, .arg = arg};
+  atomic_init(&job.next, 0);
+
+  parallel_run(&job);
+}
+
+// Like `parallel_for`, but for work on a buffer whose pages follow
+// `placement`, with every chunk of `grain` indices a band. A band is only
+// handed to a worker of the node that owns it, unless that node's workers
+// are done or there are none, and on machines with more than one node the
+// workers are pinned to their nodes for the call.
+//
+// The first touch of a fresh buffer in a `parallel_for_placed` places its
+// pages, and later calls with the same placement then work mostly on local
+// memory
+void parallel_for_placed(const uint64_t n, const uint64_t grain,
+                         const enum numa_placement_e placement,
+                         const parallel_body_t body, void *arg) {
+  assert(grain > 0);
+  assert(body);
+
+  struct parallel_job_s job = {
+      .n = n,
+      .grain = grain,
+      .body = body,
+      .arg = arg,
+      .placed = true,
+      .pinned = numa_nnodes() > 1,
+      .placement = placement,
+      .nbands = (n + grain - 1) / grain,
+  };
+  atomic_init(&job.next, 0);
+  for (uint32_t k = 0; k < NUMA_MAX_NODES; k++) {
+    atomic_init(&job.node_next[k], 0);
+  }
+
+  parallel_run(&job);
+}
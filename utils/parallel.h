@@ -0,0 +1,47 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdint.h>
+
+#include "./numa.h"
+
+// The body of a `parallel_for`: handles the indices [`begin`, `end`) on the
+// worker numbered `worker`, which is below `parallel_nthreads()`
+typedef void (*parallel_body_t)(const uint64_t begin, const uint64_t end,
+                                const uint32_t worker, void *arg);
+
+void parallel_set_nthreads(const uint32_t nthreads);
+
+uint32_t parallel_nthreads(void);
+
+void parallel_for(const uint64_t n, const uint64_t grain,
+                  const parallel_body_t body, void *arg);
+
+void parallel_for_placed(const uint64_t n, const uint64_t grain,
+                         const enum numa_placement_e placement,
+                         const parallel_body_t body, void *arg);
+
+#endif  // PARALLEL_H
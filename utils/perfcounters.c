@@ -0,0 +1,194 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#include "./perfcounters.h"
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+struct perf_event_desc_s {
+  const char *name;
+  uint32_t type;
+  uint64_t config;
+};
+
+#define HW_CACHE_READ_MISS(cache)                               \
+  ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) |               \
+   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct perf_event_desc_s event_descs[PERF_NEVENTS] = {
+    [PERF_CYCLES] = {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    [PERF_INSTRUCTIONS] = {"instructions", PERF_TYPE_HARDWARE,
+                           PERF_COUNT_HW_INSTRUCTIONS},
+    [PERF_CACHE_MISSES] = {"cache-misses", PERF_TYPE_HARDWARE,
+                           PERF_COUNT_HW_CACHE_MISSES},
+    [PERF_L1D_MISSES] = {"l1d-misses", PERF_TYPE_HW_CACHE,
+                         HW_CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D)},
+    [PERF_DTLB_MISSES] = {"dtlb-misses", PERF_TYPE_HW_CACHE,
+                          HW_CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+    [PERF_BRANCH_MISSES] = {"branch-misses", PERF_TYPE_HARDWARE,
+                            PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+// The file descriptor of every opened event, or -1. The first opened event
+// leads the group so that all of them are scheduled together
+static int event_fds[PERF_NEVENTS] = {-1, -1, -1, -1, -1, -1};
+static int group_fd = -1;
+
+static bool is_event_open(enum perf_event_e e) { return event_fds[e] >= 0; }
+
+static int open_event(const struct perf_event_desc_s *desc, int leader) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = desc->type;
+  attr.config = desc->config;
+  attr.disabled = leader == -1;
+  attr.inherit = 1;  // also count the threads the rotation starts
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+  return syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+// Opens the comma separated `events` ("all" for every event) as one counter
+// group on the calling thread and the threads it starts afterwards.
+//
+// Events that are unknown to the kernel or not permitted (see
+// /proc/sys/kernel/perf_event_paranoid) are skipped with a warning. Returns
+// false if `events` names an unknown event
+bool perf_counters_select(const char *events) {
+  bool selected[PERF_NEVENTS] = {false};
+
+  char *list = strdup(events);
+  for (char *name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+    bool found = false;
+    for (int e = 0; e < PERF_NEVENTS; e++) {
+      if (!strcmp(name, "all") || !strcmp(name, event_descs[e].name)) {
+        selected[e] = found = true;
+      }
+    }
+
+    if (!found) {
+      printf("Unknown counter: %s\n", name);
+      free(list);
+      return false;
+    }
+  }
+  free(list);
+
+  for (int e = 0; e < PERF_NEVENTS; e++) {
+    if (!selected[e]) {
+      continue;
+    }
+
+    event_fds[e] = open_event(&event_descs[e], group_fd);
+    if (event_fds[e] < 0) {
+      fprintf(stderr, "Warning: cannot count %s (%s), skipping it\n",
+              event_descs[e].name, strerror(errno));
+      continue;
+    }
+
+    if (group_fd == -1) {
+      group_fd = event_fds[e];
+    }
+  }
+
+  return true;
+}
+
+// Returns true if at least one event is being counted
+bool perf_counters_enabled(void) { return group_fd >= 0; }
+
+void perf_counters_start(void) {
+  if (group_fd < 0) {
+    return;
+  }
+
+  ioctl(group_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(group_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+// Stops counting and adds the counts since `perf_counters_start` to `counts`.
+// Counts are scaled up if the kernel had to multiplex the counters
+void perf_counters_stop(struct perf_counts_s *counts) {
+  if (group_fd < 0) {
+    return;
+  }
+
+  ioctl(group_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+  for (int e = 0; e < PERF_NEVENTS; e++) {
+    uint64_t data[3];  // value, time enabled, time running
+    if (!is_event_open(e) ||
+        read(event_fds[e], data, sizeof(data)) != sizeof(data)) {
+      continue;
+    }
+
+    double scale = data[2] ? (double)data[1] / data[2] : 0;
+    counts->values[e] += (uint64_t)(data[0] * scale);
+    counts->valid[e] = data[2] != 0;
+  }
+}
+
+// Prints the counts of `nruns` rotations of `bits` by `bits` matrices that
+// took `total_ns` nanoseconds in total, normalized per 64x64 block. Memory
+// bandwidth is estimated from the last level cache misses
+void perf_counters_print(const struct perf_counts_s *counts, const uint32_t nruns,
+                         const uint64_t bits, const uint64_t total_ns) {
+  if (group_fd < 0) {
+    return;
+  }
+
+  const double nblocks = (double)nruns * (bits / 64) * (bits / 64);
+  const char *sep = " ";
+
+  printf("\tcounters:");
+  for (int e = 0; e < PERF_NEVENTS; e++) {
+    if (counts->valid[e]) {
+      printf("%s%.2f %s/block", sep, counts->values[e] / nblocks,
+             event_descs[e].name);
+      sep = ", ";
+    }
+  }
+  if (counts->valid[PERF_CYCLES] && counts->valid[PERF_INSTRUCTIONS] &&
+      counts->values[PERF_CYCLES]) {
+    printf("%sIPC %.2f", sep,
+           (double)counts->values[PERF_INSTRUCTIONS] /
+               counts->values[PERF_CYCLES]);
+    sep = ", ";
+  }
+  if (counts->valid[PERF_CACHE_MISSES] && total_ns) {
+    printf("%s~%.2f GB/s memory", sep,
+           64.0 * counts->values[PERF_CACHE_MISSES] / total_ns);
+  }
+  printf("\n");
+}
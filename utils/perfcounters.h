@@ -0,0 +1,59 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Hardware events that can be counted around the timed rotations
+enum perf_event_e {
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_CACHE_MISSES,  // last level cache misses
+  PERF_L1D_MISSES,
+  PERF_DTLB_MISSES,
+  PERF_BRANCH_MISSES,
+  PERF_NEVENTS
+};
+
+// Counts of every event, summed over the counted runs. `valid[e]` is false
+// for events that were not selected or could not be opened
+struct perf_counts_s {
+  uint64_t values[PERF_NEVENTS];
+  bool valid[PERF_NEVENTS];
+};
+
+bool perf_counters_select(const char *events);
+
+bool perf_counters_enabled(void);
+
+void perf_counters_start(void);
+
+void perf_counters_stop(struct perf_counts_s *counts);
+
+void perf_counters_print(const struct perf_counts_s *counts, const uint32_t nruns,
+                         const uint64_t bits, const uint64_t total_ns);
+
+#endif  // PERFCOUNTERS_H
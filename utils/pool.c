@@ -0,0 +1,332 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+
+#include "./pool.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+// Class c holds (4 + c % 4) << (10 + c / 4) bytes, from 4 KiB to 1 TiB
+#define POOL_NCLASSES 113
+#define POOL_MIN_SIZE 4096
+
+// Buffers from 2 MiB are aligned to and backed by huge pages
+#define POOL_HUGE_PAGE (2 << 20)
+
+// Buffers each thread keeps for itself before it returns them to the pool
+#define POOL_THREAD_CACHE 4
+
+// The cached buffers, in the thread caches and the pool, are at most 2 GiB
+// unless `matrix_pool_set_limit` says otherwise
+#define POOL_DEFAULT_LIMIT ((size_t)2 << 30)
+
+// The table that finds the header of a buffer by its address has 2^10 buckets
+#define POOL_MAP_BUCKET_BITS 10
+#define POOL_MAP_BUCKETS (1 << POOL_MAP_BUCKET_BITS)
+
+// Describes a mapped buffer. It is kept out of the mapping, so that the data
+// starts at the first byte of its pages and a buffer of a power-of-two size
+// fills its huge pages exactly
+struct pool_header_s {
+  uint8_t *map;
+  size_t map_size;
+  uint32_t cls;
+
+  // The next buffer of the pool list or thread cache it is in
+  struct pool_header_s *next;
+
+  // The next mapped buffer in its bucket of the address table
+  struct pool_header_s *next_map;
+};
+
+static struct {
+  pthread_mutex_t lock;
+  struct pool_header_s *lists[POOL_NCLASSES];
+  _Atomic size_t cached_bytes;
+  _Atomic size_t limit;
+
+  // Every mapped buffer, by address. Taken only to map, free or unmap one
+  pthread_mutex_t map_lock;
+  struct pool_header_s *maps[POOL_MAP_BUCKETS];
+} pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .limit = POOL_DEFAULT_LIMIT,
+    .map_lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+struct pool_thread_cache_s {
+  struct pool_header_s *buffers[POOL_THREAD_CACHE];
+  uint32_t n;
+};
+
+static __thread struct pool_thread_cache_s thread_cache;
+
+// Returns the cache of a thread to the pool when the thread exits
+static pthread_key_t thread_cache_key;
+static pthread_once_t thread_cache_once = PTHREAD_ONCE_INIT;
+
+static size_t class_size(const uint32_t cls) {
+  return (size_t)(4 + cls % 4) << (10 + cls / 4);
+}
+
+// The smallest class of at least `nbytes`
+static uint32_t size_class(const size_t nbytes) {
+  if (nbytes <= POOL_MIN_SIZE) {
+    return 0;
+  }
+
+  // 2^b < `nbytes` <= 2^(b + 1), which is split in 4 classes
+  const uint32_t b = 63 - __builtin_clzll(nbytes - 1);
+  const uint32_t quarter = (nbytes + ((size_t)1 << (b - 2)) - 1) >> (b - 2);
+  return 4 * (b - 12) + quarter - 4;
+}
+
+static uint8_t *buffer_data(struct pool_header_s *header) {
+  return header->map;
+}
+
+// Buffers are page aligned, so the bits above the page offset tell them
+// apart
+static struct pool_header_s **map_bucket(const uint8_t *data) {
+  const uint64_t hash = ((uintptr_t)data >> 12) * 0x9E3779B97F4A7C15ULL;
+  return &pool.maps[hash >> (64 - POOL_MAP_BUCKET_BITS)];
+}
+
+static struct pool_header_s *buffer_header(uint8_t *data) {
+  pthread_mutex_lock(&pool.map_lock);
+  struct pool_header_s *header = *map_bucket(data);
+  while (header && header->map != data) {
+    header = header->next_map;
+  }
+  pthread_mutex_unlock(&pool.map_lock);
+
+  // `data` did not come from matrix_alloc()
+  assert(header);
+  return header;
+}
+
+static void unmap_buffer(struct pool_header_s *header) {
+  pthread_mutex_lock(&pool.map_lock);
+  struct pool_header_s **link = map_bucket(header->map);
+  while (*link != header) {
+    link = &(*link)->next_map;
+  }
+  *link = header->next_map;
+  pthread_mutex_unlock(&pool.map_lock);
+
+  munmap(header->map, header->map_size);
+  free(header);
+}
+
+// Maps a fresh buffer of class `cls`. Its pages are left to be faulted in
+// by the first writes of the caller, which places them for its own
+// geometry, like `generate_bit_matrix` and `matrix_copy` do by bands of rows.
+//
+// Returns NULL if it is out of memory
+static struct pool_header_s *map_buffer(const uint32_t cls) {
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  const size_t nbytes = class_size(cls);
+  const bool huge = nbytes >= POOL_HUGE_PAGE;
+  const size_t align = huge ? POOL_HUGE_PAGE : page_size;
+  const size_t size = (nbytes + align - 1) / align * align;
+
+  // Map enough to cut out an aligned `size`
+  const size_t map_size = huge ? size + POOL_HUGE_PAGE : size;
+  struct pool_header_s *header = malloc(sizeof(*header));
+  if (!header) {
+    return NULL;
+  }
+  uint8_t *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED) {
+    free(header);
+    return NULL;
+  }
+
+  uint8_t *start = map;
+  if (huge) {
+    start = (uint8_t *)(((uintptr_t)map + POOL_HUGE_PAGE - 1) &
+                        ~(uintptr_t)(POOL_HUGE_PAGE - 1));
+    if (start > map) {
+      munmap(map, start - map);
+    }
+    if (start + size < map + map_size) {
+      munmap(start + size, map + map_size - (start + size));
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(start, size, MADV_HUGEPAGE);
+#endif
+  }
+
+  header->map = start;
+  header->map_size = size;
+  header->cls = cls;
+  header->next = NULL;
+
+  pthread_mutex_lock(&pool.map_lock);
+  struct pool_header_s **bucket = map_bucket(start);
+  header->next_map = *bucket;
+  *bucket = header;
+  pthread_mutex_unlock(&pool.map_lock);
+  return header;
+}
+
+static void push_to_pool(struct pool_header_s *header) {
+  pthread_mutex_lock(&pool.lock);
+  header->next = pool.lists[header->cls];
+  pool.lists[header->cls] = header;
+  pthread_mutex_unlock(&pool.lock);
+}
+
+static void flush_thread_cache(void *arg) {
+  struct pool_thread_cache_s *cache = arg;
+  for (uint32_t k = 0; k < cache->n; k++) {
+    push_to_pool(cache->buffers[k]);
+  }
+  cache->n = 0;
+}
+
+static void create_thread_cache_key(void) {
+  pthread_key_create(&thread_cache_key, flush_thread_cache);
+}
+
+// Returns a buffer of at least `nbytes` bytes, aligned to a page, or to a
+// huge page from 2 MiB. The
+// smallest cached buffer that fits is reused, from the thread cache first.
+//
+// Returns NULL if it is out of memory
+uint8_t *matrix_alloc(const size_t nbytes) {
+  const uint32_t cls = size_class(nbytes);
+  assert(cls < POOL_NCLASSES);
+
+  // Best fit in the thread cache
+  struct pool_thread_cache_s *cache = &thread_cache;
+  uint32_t best = cache->n;
+  for (uint32_t k = 0; k < cache->n; k++) {
+    const uint32_t c = cache->buffers[k]->cls;
+    if (c >= cls && (best == cache->n || c < cache->buffers[best]->cls)) {
+      best = k;
+    }
+  }
+
+  struct pool_header_s *header = NULL;
+  if (best < cache->n) {
+    header = cache->buffers[best];
+    cache->buffers[best] = cache->buffers[--cache->n];
+  } else {
+    pthread_mutex_lock(&pool.lock);
+    for (uint32_t c = cls; c < POOL_NCLASSES && !header; c++) {
+      header = pool.lists[c];
+      if (header) {
+        pool.lists[c] = header->next;
+      }
+    }
+    pthread_mutex_unlock(&pool.lock);
+  }
+
+  if (header) {
+    atomic_fetch_sub(&pool.cached_bytes, header->map_size);
+  } else {
+    header = map_buffer(cls);
+    if (!header) {
+      return NULL;
+    }
+  }
+
+  return buffer_data(header);
+}
+
+// Returns `buffer`, from `matrix_alloc`, to the pool. It is unmapped instead
+// if the pool is full. NULL is ignored
+void matrix_free(uint8_t *buffer) {
+  if (!buffer) {
+    return;
+  }
+
+  struct pool_header_s *header = buffer_header(buffer);
+  if (atomic_fetch_add(&pool.cached_bytes, header->map_size) +
+          header->map_size > atomic_load(&pool.limit)) {
+    atomic_fetch_sub(&pool.cached_bytes, header->map_size);
+    unmap_buffer(header);
+    return;
+  }
+
+  struct pool_thread_cache_s *cache = &thread_cache;
+  if (cache->n < POOL_THREAD_CACHE) {
+    // The first buffer of a thread registers its cache to be flushed
+    pthread_once(&thread_cache_once, create_thread_cache_key);
+    pthread_setspecific(thread_cache_key, cache);
+    cache->buffers[cache->n++] = header;
+    return;
+  }
+
+  push_to_pool(header);
+}
+
+// Maps `count` buffers of at least `nbytes` bytes into the pool ahead of
+// their use, so that allocations of up to `nbytes` do not map. Their pages
+// are still faulted in by their first user. The limit of the pool does not
+// apply to them
+void matrix_pool_reserve(const size_t nbytes, const uint32_t count) {
+  const uint32_t cls = size_class(nbytes);
+  assert(cls < POOL_NCLASSES);
+
+  for (uint32_t k = 0; k < count; k++) {
+    struct pool_header_s *header = map_buffer(cls);
+    if (!header) {
+      return;
+    }
+    atomic_fetch_add(&pool.cached_bytes, header->map_size);
+    push_to_pool(header);
+  }
+}
+
+// Sets the most bytes the cached buffers may take. Buffers freed past it are
+// unmapped
+void matrix_pool_set_limit(const size_t nbytes) {
+  atomic_store(&pool.limit, nbytes);
+}
+
+// Unmaps the buffers in the pool and in the cache of the calling thread. The
+// caches of other threads are kept until they exit
+void matrix_pool_trim(void) {
+  flush_thread_cache(&thread_cache);
+
+  pthread_mutex_lock(&pool.lock);
+  for (uint32_t c = 0; c < POOL_NCLASSES; c++) {
+    while (pool.lists[c]) {
+      struct pool_header_s *header = pool.lists[c];
+      pool.lists[c] = header->next;
+      atomic_fetch_sub(&pool.cached_bytes, header->map_size);
+      unmap_buffer(header);
+    }
+  }
+  pthread_mutex_unlock(&pool.lock);
+}
@@ -0,0 +1,52 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A pool of reusable bit matrix buffers. Buffers are page aligned and come in
+// size classes of 4 per doubling, from 4 KiB. A freed buffer is kept for the
+// next allocation of its class or a smaller one, first in a small cache of
+// the freeing thread and then in a pool shared by all threads.
+//
+// Fresh buffers are mapped from the kernel, aligned to and backed by
+// transparent huge pages from 2 MiB. Their pages are not touched, so that
+// the first writes of the caller place them on the NUMA nodes of its threads.
+// A reused buffer keeps the pages and placement of its earlier users and
+// holds whatever was last written to it
+
+uint8_t *matrix_alloc(const size_t nbytes);
+
+void matrix_free(uint8_t *buffer);
+
+void matrix_pool_reserve(const size_t nbytes, const uint32_t count);
+
+void matrix_pool_set_limit(const size_t nbytes);
+
+void matrix_pool_trim(void);
+
+#endif  // POOL_H
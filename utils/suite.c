@@ -0,0 +1,229 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#include "./suite.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "./machine.h"
+
+// The Makefile records the commit and the compiler flags of the build. They
+// are unknown when building some other way
+#ifndef BUILD_GIT_HASH
+#define BUILD_GIT_HASH "unknown"
+#endif
+#ifndef BUILD_CFLAGS
+#define BUILD_CFLAGS "unknown"
+#endif
+
+// The one-sided significance level of the regression test is 5%
+#define SUITE_Z_CRITICAL 1.6449
+
+#define SUITE_MAGIC "# rotate benchmark suite v1"
+
+// Starts empty results keyed by this build and host
+void suite_results_init(struct suite_results_s *results) {
+  memset(results, 0, sizeof(*results));
+  snprintf(results->git_hash, sizeof(results->git_hash), "%s", BUILD_GIT_HASH);
+  snprintf(results->flags, sizeof(results->flags), "%s", BUILD_CFLAGS);
+  detect_cpu_model(results->cpu, sizeof(results->cpu));
+}
+
+// Records the timing `stats` of the case `name` on an `N` by `N` matrix
+void suite_results_add(struct suite_results_s *results, const char *name,
+                       const bits_t N, const struct timing_stats_s *stats) {
+  assert(results->ncases < SUITE_MAX_CASES);
+  // Names are saved as a single word
+  assert(!strpbrk(name, " \t\n"));
+
+  struct suite_case_s *c = &results->cases[results->ncases++];
+  snprintf(c->name, sizeof(c->name), "%s", name);
+  c->N = N;
+  c->nsamples = stats->nsamples;
+  c->mean_ns = stats->mean_ns;
+  c->stddev_ns = stats->stddev_ns;
+  c->median_ns = stats->median_ns;
+}
+
+// Writes `results` to `fname` as text, one case per line.
+//
+// Returns `false` if there was an error
+bool suite_results_save(const struct suite_results_s *results,
+                        const char *fname) {
+  FILE *f = fopen(fname, "w");
+
+  // There was some sort of error
+  if (!f) {
+    perror("Error writing benchmark results");
+    return false;
+  }
+
+  fprintf(f, SUITE_MAGIC "\n");
+  fprintf(f, "git %s\n", results->git_hash);
+  fprintf(f, "cpu %s\n", results->cpu);
+  fprintf(f, "flags %s\n", results->flags);
+  for (uint32_t i = 0; i < results->ncases; i++) {
+    const struct suite_case_s *c = &results->cases[i];
+    fprintf(f, "case %s %zu %u %.1f %.1f %" PRIu64 "\n", c->name, c->N,
+            c->nsamples, c->mean_ns, c->stddev_ns, c->median_ns);
+  }
+
+  fclose(f);
+  return true;
+}
+
+// Saves the rest of `line` after the key into `value`, without the newline
+static void read_value(const char *line, char *value, const size_t size) {
+  const char *space = strchr(line, ' ');
+  snprintf(value, size, "%s", space ? space + 1 : "");
+  value[strcspn(value, "\n")] = '\0';
+}
+
+// Reads the results written by `suite_results_save` from `fname`.
+//
+// Returns `false` if there was an error
+bool suite_results_load(struct suite_results_s *results, const char *fname) {
+  FILE *f = fopen(fname, "r");
+
+  // There was some sort of error
+  if (!f) {
+    perror("Error reading benchmark results");
+    return false;
+  }
+
+  memset(results, 0, sizeof(*results));
+
+  char line[1024];
+  if (!fgets(line, sizeof(line), f) ||
+      strncmp(line, SUITE_MAGIC, strlen(SUITE_MAGIC))) {
+    fprintf(stderr,
+            "Error reading benchmark results: %s is not a results file\n",
+            fname);
+    fclose(f);
+    return false;
+  }
+
+  while (fgets(line, sizeof(line), f)) {
+    if (!strncmp(line, "git ", 4)) {
+      read_value(line, results->git_hash, sizeof(results->git_hash));
+    } else if (!strncmp(line, "cpu ", 4)) {
+      read_value(line, results->cpu, sizeof(results->cpu));
+    } else if (!strncmp(line, "flags ", 6)) {
+      read_value(line, results->flags, sizeof(results->flags));
+    } else if (!strncmp(line, "case ", 5) &&
+               results->ncases < SUITE_MAX_CASES) {
+      struct suite_case_s *c = &results->cases[results->ncases];
+      if (sscanf(line, "case %63s %zu %u %lf %lf %" SCNu64, c->name, &c->N,
+                 &c->nsamples, &c->mean_ns, &c->stddev_ns,
+                 &c->median_ns) == 6) {
+        results->ncases++;
+      }
+    }
+  }
+
+  fclose(f);
+  return true;
+}
+
+// The one-sided critical value of Student's t distribution with `df` degrees
+// of freedom, from the Cornish-Fisher expansion around the normal quantile
+static double t_critical(const double df) {
+  const double z = SUITE_Z_CRITICAL;
+  const double z3 = z * z * z, z5 = z3 * z * z;
+  return z + (z3 + z) / (4 * df) + (5 * z5 + 16 * z3 + 3 * z) / (96 * df * df);
+}
+
+// Compares the mean times of `results` against `baseline` case by case with
+// Welch's t-test. A case regressed if it is slower by more than the relative
+// `threshold` and the slowdown is significant. Prints a table of the
+// comparison.
+//
+// Returns the number of regressed cases
+uint32_t suite_results_compare(const struct suite_results_s *baseline,
+                               const struct suite_results_s *results,
+                               const double threshold) {
+  printf("Baseline: git %s\n", baseline->git_hash);
+  if (strcmp(baseline->cpu, results->cpu)) {
+    printf(COLOR_YELLOW "Warning: baseline was measured on \"%s\", this is "
+                        "\"%s\"" COLOR_DEFAULT "\n",
+           baseline->cpu, results->cpu);
+  }
+  if (strcmp(baseline->flags, results->flags)) {
+    printf(COLOR_YELLOW "Warning: baseline was built with \"%s\", this is "
+                        "\"%s\"" COLOR_DEFAULT "\n",
+           baseline->flags, results->flags);
+  }
+
+  uint32_t nregressions = 0;
+  for (uint32_t i = 0; i < results->ncases; i++) {
+    const struct suite_case_s *c = &results->cases[i];
+
+    const struct suite_case_s *b = NULL;
+    for (uint32_t j = 0; j < baseline->ncases; j++) {
+      if (!strcmp(baseline->cases[j].name, c->name) &&
+          baseline->cases[j].N == c->N) {
+        b = &baseline->cases[j];
+        break;
+      }
+    }
+    if (!b) {
+      printf("\t%-20s N=%-6zu not in baseline\n", c->name, c->N);
+      continue;
+    }
+
+    const double change = (c->mean_ns - b->mean_ns) / b->mean_ns;
+
+    // Welch's t statistic and the Welch-Satterthwaite degrees of freedom.
+    // With a single sample on either side there is no variance to test, so
+    // only the threshold applies
+    const double vc = c->stddev_ns * c->stddev_ns / c->nsamples;
+    const double vb = b->stddev_ns * b->stddev_ns / b->nsamples;
+    bool significant = true;
+    double t = 0;
+    if (c->nsamples > 1 && b->nsamples > 1 && vc + vb > 0) {
+      t = (c->mean_ns - b->mean_ns) / sqrt(vc + vb);
+      const double df = (vc + vb) * (vc + vb) /
+                        (vc * vc / (c->nsamples - 1) +
+                         vb * vb / (b->nsamples - 1));
+      significant = fabs(t) > t_critical(df);
+    }
+
+    const char *verdict = "ok";
+    if (change > threshold && significant) {
+      verdict = FAIL_STR " regression";
+      nregressions++;
+    } else if (change < -threshold && significant) {
+      verdict = PASS_STR " improvement";
+    }
+
+    printf("\t%-20s N=%-6zu %10.3f ms -> %10.3f ms  %+6.1f%%  t=%+6.2f  %s\n",
+           c->name, c->N, b->mean_ns / 1e6, c->mean_ns / 1e6, 100 * change, t,
+           verdict);
+  }
+
+  return nregressions;
+}
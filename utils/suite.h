@@ -0,0 +1,70 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#ifndef SUITE_H
+#define SUITE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "./tester.h"
+
+#define SUITE_MAX_CASES 32
+#define SUITE_NAME_LENGTH 64
+
+// The timing of one case of the benchmark suite. Cases are matched against
+// the baseline by `name` and `N`
+struct suite_case_s {
+  char name[SUITE_NAME_LENGTH];
+  bits_t N;
+  uint32_t nsamples;
+  double mean_ns;
+  double stddev_ns;
+  uint64_t median_ns;
+};
+
+// The results of one run of the benchmark suite, keyed by the build and the
+// host they were measured on
+struct suite_results_s {
+  char git_hash[64];
+  char cpu[128];
+  char flags[512];
+  uint32_t ncases;
+  struct suite_case_s cases[SUITE_MAX_CASES];
+};
+
+void suite_results_init(struct suite_results_s *results);
+
+void suite_results_add(struct suite_results_s *results, const char *name,
+                       const bits_t N, const struct timing_stats_s *stats);
+
+bool suite_results_save(const struct suite_results_s *results,
+                        const char *fname);
+
+bool suite_results_load(struct suite_results_s *results, const char *fname);
+
+uint32_t suite_results_compare(const struct suite_results_s *baseline,
+                               const struct suite_results_s *results,
+                               const double threshold);
+
+#endif  // SUITE_H
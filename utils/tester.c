@@ -21,32 +21,237 @@
  **/
 #include "./tester.h"
 
+#include <inttypes.h>
 #include <math.h>
 #include <signal.h>
 #include <string.h>
 #include <unistd.h>
 
 #include "./fasttime.h"
+#include "./fingerprint.h"
 #include "./libbmp.h"
+#include "./libpbm.h"
+#include "./machine.h"
+#include "./parallel.h"
+#include "./pool.h"
+#include "./suite.h"
+#include "./trace.h"
 #include "./utils.h"
+#include "../snailspeed/librotate.h"
 
 void exitfunc(int sig) {
   printf("End execution due to 58s timeout\n");
   exit(0);
 }
 
+// The number of untimed warmup runs and timed runs of every rotation under
+// test, and whether to also count TSC cycles
+static uint32_t timing_warmup = 0;
+static uint32_t timing_reps = 1;
+static bool timing_cycles = false;
+
+// Sets how every rotation under test is timed: `warmup` untimed runs, then
+// `reps` timed runs. If `cycles` is set, TSC cycles are counted as well.
+//
+// The defaults (no warmup, a single run, no cycles) time exactly one call
+void set_timing_options(const uint32_t warmup, const uint32_t reps,
+                        const bool cycles) {
+  assert(reps > 0);
+
+  timing_warmup = warmup;
+  timing_reps = reps;
+  timing_cycles = cycles;
+}
+
+static int compare_u64(const void *a, const void *b) {
+  const uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// Times `rotate_fn` on `data` according to the timing options and saves the
+// summary in `stats`.
+//
+// Each call rotates `data` by 90 degrees in total: when the warmup and timed
+// runs do not add up to 1 modulo 4, untimed runs are added at the end, so the
+// result can still be checked against a single stock rotation
+void measure_rotation(const rotate_fn_t rotate_fn, uint8_t *const data,
+                      const bits_t N, struct timing_stats_s *stats) {
+  const uint32_t nruns = timing_warmup + timing_reps;
+  const uint32_t nsettle = (4 - (nruns + 3) % 4) % 4;
+
+  uint64_t *ns = malloc(timing_reps * sizeof(uint64_t));
+  uint64_t *cycles = malloc(timing_reps * sizeof(uint64_t));
+  assert(ns && cycles);
+
+  for (uint32_t r = 0; r < timing_warmup; r++) {
+    rotate_fn(data, N);
+  }
+
+  memset(&stats->counts, 0, sizeof(stats->counts));
+
+  for (uint32_t r = 0; r < timing_reps; r++) {
+    const uint64_t trace_start = trace_enabled() ? trace_now() : 0;
+    perf_counters_start();
+    const uint64_t start_cycles = timing_cycles ? getcycles() : 0;
+    fasttime_t start = gettime();
+    rotate_fn(data, N);
+    fasttime_t stop = gettime();
+    const uint64_t stop_cycles = timing_cycles ? getcycles() : 0;
+    perf_counters_stop(&stats->counts);
+
+    trace_span(TRACE_STAGE, "rotate", trace_start, N, 0);
+
+    ns[r] = tdiff_nsec(start, stop);
+    cycles[r] = stop_cycles - start_cycles;
+  }
+
+  for (uint32_t r = 0; r < nsettle; r++) {
+    rotate_fn(data, N);
+  }
+
+  double sum = 0;
+  for (uint32_t r = 0; r < timing_reps; r++) {
+    sum += ns[r];
+  }
+  stats->nsamples = timing_reps;
+  stats->total_ns = sum;
+  stats->mean_ns = sum / timing_reps;
+
+  double sum_sq = 0;
+  for (uint32_t r = 0; r < timing_reps; r++) {
+    sum_sq += (ns[r] - stats->mean_ns) * (ns[r] - stats->mean_ns);
+  }
+  stats->stddev_ns = timing_reps > 1 ? sqrt(sum_sq / (timing_reps - 1)) : 0;
+
+  qsort(ns, timing_reps, sizeof(uint64_t), compare_u64);
+  qsort(cycles, timing_reps, sizeof(uint64_t), compare_u64);
+
+  const uint32_t median = (timing_reps - 1) / 2;
+  const uint32_t p90 = (uint32_t)ceil(0.9 * timing_reps) - 1;
+  stats->min_ns = ns[0];
+  stats->median_ns = ns[median];
+  stats->p90_ns = ns[p90];
+  stats->min_cycles = cycles[0];
+  stats->median_cycles = cycles[median];
+
+  free(ns);
+  free(cycles);
+}
+
+// Prints `stats` for an `N` by `N` rotation, normalized per 64x64 block and
+// as bytes of matrix rotated per second
+void print_timing_stats(const struct timing_stats_s *stats, const bits_t N) {
+  const double nblocks = (double)(N / 64) * (N / 64);
+  const double nbytes = (double)N * N / 8;
+
+  printf("\t%u run%s: min %" PRIu64 " ns, median %" PRIu64 " ns, p90 %" PRIu64
+         " ns, stddev %.0f ns, %.1f ns/block",
+         stats->nsamples, stats->nsamples == 1 ? "" : "s", stats->min_ns,
+         stats->median_ns, stats->p90_ns, stats->stddev_ns,
+         stats->median_ns / nblocks);
+  if (timing_cycles) {
+    printf(", %.1f cycles/block", stats->median_cycles / nblocks);
+  }
+  printf(", %.2f GB/s\n", nbytes / stats->median_ns);
+
+  perf_counters_print(&stats->counts, stats->nsamples, N, stats->total_ns);
+}
+
+// Times `rotate_fn` with the timing options and returns the median time in
+// milliseconds. The statistics are printed unless they would only repeat the
+// single-shot time
 static uint32_t timed_eval(rotate_fn_t rotate_fn, uint8_t *const data,
                            const bits_t bits) {
+  struct timing_stats_s stats;
+  measure_rotation(rotate_fn, data, bits, &stats);
+
+  if (timing_reps > 1 || timing_warmup > 0 || timing_cycles ||
+      perf_counters_enabled()) {
+    print_timing_stats(&stats, bits);
+  }
+  return stats.median_ns / 1000000;
+}
+
+// Times a single call of `rotate_fn`, for the stock rotation which is too
+// slow to repeat
+static uint32_t timed_eval_once(rotate_fn_t rotate_fn, uint8_t *const data,
+                                const bits_t bits) {
   fasttime_t start = gettime();
   rotate_fn(data, bits);
   fasttime_t stop = gettime();
   return tdiff_msec(start, stop);
 }
 
-// Rotates a bit array clockwise 90 degrees.
+// An input image in any of the supported file formats
+struct image_s {
+  uint8_t *data;
+  int width;
+  int height;
+  int row_size;
+
+  bool is_pbm;
+  struct pbm_image_s pbm;
+  struct color_table_s color_tables[2];
+};
+
+// Reads `fname` into `image`, detecting whether it is a BMP or a P4 PBM file
+// from its magic number.
+//
+// Returns `false` if there was an error
+static bool read_image(const char *const fname, struct image_s *image) {
+  const uint64_t trace_start = trace_enabled() ? trace_now() : 0;
+  image->is_pbm = is_binary_pbm(fname);
+
+  if (image->is_pbm) {
+    if (!read_binary_pbm(fname, &image->pbm)) {
+      return false;
+    }
+
+    image->data = image->pbm.data;
+    image->width = image->pbm.width;
+    image->height = image->pbm.height;
+    image->row_size = image->pbm.row_size;
+  } else {
+    image->data = read_binary_bmp(fname, &image->width, &image->height,
+                                  &image->row_size, image->color_tables);
+  }
+
+  if (image->data) {
+    trace_span(TRACE_IO, "read image", trace_start,
+               (uint64_t)image->row_size * image->height, 0);
+  }
+  return image->data != NULL;
+}
+
+// Writes the `N` by `N` `image_data` to `output_fname` in the same format
+// that `image` was read in
+static void write_image(const char *const output_fname,
+                        struct image_s *image, uint8_t *image_data,
+                        const uint32_t N) {
+  const uint64_t trace_start = trace_enabled() ? trace_now() : 0;
+  if (image->is_pbm) {
+    write_binary_pbm(output_fname, image_data, N);
+  } else {
+    write_binary_bmp(output_fname, image_data, image->color_tables, N);
+  }
+  trace_span(TRACE_IO, "write image", trace_start, (uint64_t)N * N / 8, 0);
+}
+
+static void free_image(struct image_s *image) {
+  if (image->is_pbm) {
+    free_binary_pbm(&image->pbm);
+  } else {
+    free(image->data);
+  }
+  image->data = NULL;
+}
+
+// Rotates a bit array clockwise 90 degrees one bit at a time. Too slow for
+// anything but checking `reference_rotate_bit_matrix` on small matrices.
 //
 // The bit array is of `N` by `N` bits where N is a multiple of 64 and N >= 64
-static void _rotate_bit_matrix(uint8_t *const bit_matrix, const bits_t N) {
+static void bitwise_rotate_bit_matrix(uint8_t *const bit_matrix,
+                                      const bits_t N) {
   // Get the number of bytes per row in `bit_matrix`
   const uint32_t row_size = bits_to_bytes(N);
 
@@ -77,6 +282,156 @@ static void _rotate_bit_matrix(uint8_t *const bit_matrix, const bits_t N) {
   return;
 }
 
+// Loads the 8 by 8 bit tile in tile row `r` and tile column `c`
+static inline uint64_t load_tile_8(const uint8_t *bit_matrix,
+                                   const bytes_t row_size, const uint64_t r,
+                                   const uint64_t c) {
+  uint64_t x = 0;
+  for (int k = 0; k < 8; k++) {
+    x = (x << 8) | bit_matrix[(8 * r + k) * row_size + c];
+  }
+  return x;
+}
+
+static inline void store_tile_8(uint8_t *bit_matrix, const bytes_t row_size,
+                                const uint64_t r, const uint64_t c,
+                                uint64_t x) {
+  for (int k = 7; k >= 0; k--, x >>= 8) {
+    bit_matrix[(8 * r + k) * row_size + c] = x;
+  }
+}
+
+// Rotating a tile clockwise flips its rows upside down, which reverses its
+// bytes, and then transposes it
+static inline uint64_t rotate_tile_8(const uint64_t x) {
+  return transpose_tile_8(__builtin_bswap64(x));
+}
+
+struct reference_rotation_s {
+  uint8_t *bit_matrix;
+  bytes_t row_size;
+  uint64_t ntiles;  // tiles per row
+};
+
+// Rotates the 4-cycles of tiles starting in the rows [`begin`, `end`) of the
+// top-left quadrant of tiles. Tile (r, c) moves to (c, ntiles - 1 - r)
+static void reference_rotate_rows(const uint64_t begin, const uint64_t end,
+                                  const uint32_t worker, void *arg) {
+  const struct reference_rotation_s *rotation = arg;
+  uint8_t *const bit_matrix = rotation->bit_matrix;
+  const bytes_t row_size = rotation->row_size;
+  const uint64_t last = rotation->ntiles - 1;
+
+  for (uint64_t r = begin; r < end; r++) {
+    for (uint64_t c = 0; c < rotation->ntiles / 2; c++) {
+      const uint64_t t0 = load_tile_8(bit_matrix, row_size, r, c);
+      const uint64_t t1 = load_tile_8(bit_matrix, row_size, c, last - r);
+      const uint64_t t2 = load_tile_8(bit_matrix, row_size, last - r, last - c);
+      const uint64_t t3 = load_tile_8(bit_matrix, row_size, last - c, r);
+
+      store_tile_8(bit_matrix, row_size, c, last - r, rotate_tile_8(t0));
+      store_tile_8(bit_matrix, row_size, last - r, last - c, rotate_tile_8(t1));
+      store_tile_8(bit_matrix, row_size, last - c, r, rotate_tile_8(t2));
+      store_tile_8(bit_matrix, row_size, r, c, rotate_tile_8(t3));
+    }
+  }
+}
+
+// Rotates a bit array clockwise 90 degrees. This is the reference the code
+// under test is checked against, so it is kept simple and shares nothing
+// with it: 8 by 8 bit tiles are moved in 4-cycles, like the bits of
+// `bitwise_rotate_bit_matrix`, and rotated with a byte swap and a transpose.
+// The rows of tiles are split between threads. Row r of the top-left
+// quadrant goes to the node that owns rows r and ntiles - 1 - r when the
+// matrix was placed by mirrored bands, so that at least half of every 4-cycle
+// is on local memory.
+//
+// The bit array is of `N` by `N` bits where N is a multiple of 64 and N >= 64
+static void reference_rotate_bit_matrix(uint8_t *const bit_matrix,
+                                        const bits_t N) {
+  struct reference_rotation_s rotation = {
+      .bit_matrix = bit_matrix,
+      .row_size = bits_to_bytes(N),
+      .ntiles = N / 8,
+  };
+
+  parallel_for_placed(rotation.ntiles / 2, 8, NUMA_BLOCKED,
+                      reference_rotate_rows, &rotation);
+}
+
+// The largest matrix the stock rotation is checked against
+// `bitwise_rotate_bit_matrix` for in the correctness tester
+#define BITWISE_CHECK_MAX_N 1024
+
+static const char *quadrant_name(const uint64_t i, const uint64_t j,
+                                 const bits_t N) {
+  // The middle block of an odd number of blocks is in no quadrant
+  if ((N / 64) % 2 && i == (N - 64) / 2 && j == (N - 64) / 2) {
+    return "middle";
+  }
+  if (j < N / 2) {
+    return i < N / 2 ? "top-left" : "top-right";
+  }
+  return i < N / 2 ? "bottom-left" : "bottom-right";
+}
+
+// Compares `actual`, an `N` by `N` bit matrix rotated by the code under test,
+// against the `expected` reference rotation. If they differ, prints the first
+// mismatching 64x64 block in row-major order with its quadrant and the first
+// wrong bit in it, and how many blocks are wrong.
+//
+// Returns `true` if they are equal
+static bool check_rotation(const uint8_t *const expected,
+                           const uint8_t *const actual, const bits_t N) {
+  const bytes_t row_size = bits_to_bytes(N);
+  bytes_t first_diff;
+  if (matrix_equal(expected, actual, row_size * N, &first_diff)) {
+    return true;
+  }
+
+  const uint64_t nblocks = N / 64;
+  uint64_t nwrong = 0, first_i = 0, first_j = 0;
+
+  // The rows before the first differing byte are right
+  for (uint64_t bj = first_diff / row_size / 64; bj < nblocks; bj++) {
+    for (uint64_t bi = 0; bi < nblocks; bi++) {
+      bool wrong = false;
+      for (uint64_t y = 64 * bj; y < 64 * (bj + 1) && !wrong; y++) {
+        wrong = memcmp(expected + y * row_size + 8 * bi,
+                       actual + y * row_size + 8 * bi, 8) != 0;
+      }
+      if (wrong && !nwrong++) {
+        first_i = 64 * bi;
+        first_j = 64 * bj;
+      }
+    }
+  }
+
+  // The first wrong bit of the first wrong block
+  uint64_t bit_i = first_i, bit_j = first_j;
+  for (uint64_t y = first_j; y < first_j + 64; y++) {
+    uint64_t x = first_i;
+    while (x < first_i + 64 &&
+           get_bit((uint8_t *)expected, row_size, x, y) ==
+               get_bit((uint8_t *)actual, row_size, x, y)) {
+      x++;
+    }
+    if (x < first_i + 64) {
+      bit_i = x;
+      bit_j = y;
+      break;
+    }
+  }
+
+  printf(FAIL_STR ": First mismatching 64x64 block at (i, j) = (%" PRIu64
+                  ", %" PRIu64 "), in the %s quadrant, first wrong bit at "
+                  "(%" PRIu64 ", %" PRIu64 "). %" PRIu64 " of %" PRIu64
+                  " blocks are wrong\n",
+         first_i, first_j, quadrant_name(first_i, first_j, N), bit_i, bit_j,
+         nwrong, nblocks * nblocks);
+  return false;
+}
+
 // Runs the tester for the input file `fname`. Tests the
 // user supplied `rotate_fn` function against a working
 // stock rotation function.
@@ -87,16 +442,17 @@ bool run_tester(const char *const fname, const rotate_fn_t rotate_fn) {
   assert(fname);
   assert(rotate_fn);
 
-  struct color_table_s color_tables[2];
-  int width, height, row_size;
-  uint8_t *bit_matrix =
-      read_binary_bmp(fname, &width, &height, &row_size, color_tables);
+  struct image_s image;
 
   // Check whether there was an error
-  if (!bit_matrix) {
+  if (!read_image(fname, &image)) {
     return false;
   }
 
+  uint8_t *bit_matrix = image.data;
+  const int width = image.width, height = image.height;
+  const int row_size = image.row_size;
+
   // Assert that the image is square, that the dimensions are >= 64
   // bits and a multiple of 64.
   //
@@ -110,21 +466,21 @@ bool run_tester(const char *const fname, const rotate_fn_t rotate_fn) {
 
   // Make a copy of `bit_matrix` for the user function to rotate
   const bytes_t bit_matrix_size = height * row_size;
-  uint8_t *bit_matrix_copy = aligned_alloc(64, bit_matrix_size);
-  memcpy(bit_matrix_copy, bit_matrix, bit_matrix_size);
+  uint8_t *bit_matrix_copy = matrix_alloc(bit_matrix_size);
+  matrix_copy(bit_matrix_copy, bit_matrix, bit_matrix_size);
 
   // Call the user-defined `rotate_fn` and time it
   const uint32_t user_msec = timed_eval(rotate_fn, bit_matrix, width);
 
   // Call our stock rotation function on `bit_matrix`
   const uint32_t stock_msec =
-      timed_eval(_rotate_bit_matrix, bit_matrix_copy, width);
+      timed_eval_once(reference_rotate_bit_matrix, bit_matrix_copy, width);
 
-  bool result = memcmp(bit_matrix, bit_matrix_copy, bit_matrix_size) == 0;
+  bool result = check_rotation(bit_matrix_copy, bit_matrix, width);
 
   // Clean up after ourselves!
-  free(bit_matrix_copy);
-  free(bit_matrix);
+  matrix_free(bit_matrix_copy);
+  free_image(&image);
 
   // Print the time taken to rotate the images using the
   // user-define `rotate_fn` and stock function
@@ -152,16 +508,17 @@ bool run_tester_save_output(const char *const fname,
   assert(output_fname);
   assert(rotate_fn);
 
-  struct color_table_s color_tables[2];
-  int width, height, row_size;
-  uint8_t *bit_matrix =
-      read_binary_bmp(fname, &width, &height, &row_size, color_tables);
+  struct image_s image;
 
   // Check whether there was an error
-  if (!bit_matrix) {
+  if (!read_image(fname, &image)) {
     return false;
   }
 
+  uint8_t *bit_matrix = image.data;
+  const int width = image.width, height = image.height;
+  const int row_size = image.row_size;
+
   // Assert that the image is square, that the dimensions are >= 64
   // bits and a multiple of 64.
   //
@@ -179,20 +536,20 @@ bool run_tester_save_output(const char *const fname,
   if (correctness) {
     // Make a copy of `bit_matrix` for the stock function to rotate
     const bytes_t bit_matrix_size = height * row_size;
-    bit_matrix_copy = aligned_alloc(64, bit_matrix_size);
-    memcpy(bit_matrix_copy, bit_matrix, bit_matrix_size);
+    bit_matrix_copy = matrix_alloc(bit_matrix_size);
+    matrix_copy(bit_matrix_copy, bit_matrix, bit_matrix_size);
 
     // Call the user-defined `rotate_fn` and time it
     const uint32_t user_msec = timed_eval(rotate_fn, bit_matrix, width);
 
     // Write the rotated output to `output_fname`
-    write_binary_bmp(output_fname, bit_matrix, color_tables, width);
+    write_image(output_fname, &image, bit_matrix, width);
 
     // Call our stock rotation function on `bit_matrix`
     const uint32_t stock_msec =
-        timed_eval(_rotate_bit_matrix, bit_matrix_copy, width);
+        timed_eval_once(reference_rotate_bit_matrix, bit_matrix_copy, width);
 
-    result = memcmp(bit_matrix_copy, bit_matrix, bit_matrix_size) == 0;
+    result = check_rotation(bit_matrix_copy, bit_matrix, width);
 
     // Print the time taken to rotate the images using the
     // user-define `rotate_fn` and stock function
@@ -206,7 +563,7 @@ bool run_tester_save_output(const char *const fname,
     const uint32_t user_msec = timed_eval(rotate_fn, bit_matrix, width);
 
     // Write the rotated output to `output_fname`
-    write_binary_bmp(output_fname, bit_matrix, color_tables, width);
+    write_image(output_fname, &image, bit_matrix, width);
 
     // Print the time taken to rotate the image using the
     // user-define `rotate_fn`
@@ -214,8 +571,8 @@ bool run_tester_save_output(const char *const fname,
   }
 
   // Clean up after ourselves!
-  free(bit_matrix_copy);
-  free(bit_matrix);
+  matrix_free(bit_matrix_copy);
+  free_image(&image);
 
   return result;
 }
@@ -263,9 +620,6 @@ bool run_tester_generated_bit_matrix(const rotate_fn_t rotate_fn,
   // Checks whether `N` is a multiple of 64
   assert(!(N % 64));
 
-  const bytes_t row_size = bits_to_bytes(N);
-
-  const bytes_t bit_matrix_size = N * row_size;
   uint8_t *bit_matrix = generate_bit_matrix(N, false);
   uint8_t *bit_matrix_copy = copy_bit_matrix(bit_matrix, N);
 
@@ -274,13 +628,13 @@ bool run_tester_generated_bit_matrix(const rotate_fn_t rotate_fn,
 
   // Call our stock rotation function on `bit_matrix`
   const uint32_t stock_msec =
-      timed_eval(_rotate_bit_matrix, bit_matrix_copy, N);
+      timed_eval_once(reference_rotate_bit_matrix, bit_matrix_copy, N);
 
-  bool result = memcmp(bit_matrix, bit_matrix_copy, bit_matrix_size) == 0;
+  bool result = check_rotation(bit_matrix_copy, bit_matrix, N);
 
   // Clean up after ourselves!
-  free(bit_matrix);
-  free(bit_matrix_copy);
+  matrix_free(bit_matrix);
+  matrix_free(bit_matrix_copy);
 
   // Print the time taken to rotate the images using the
   // user-define `rotate_fn` and stock function
@@ -290,6 +644,75 @@ bool run_tester_generated_bit_matrix(const rotate_fn_t rotate_fn,
   return result;
 }
 
+// Runs the tester on a generated bit matrix without a second copy of it:
+// the rows and columns of the input are fingerprinted before the user
+// supplied `rotate_fn` rotates it, and the output is checked against the
+// fingerprints, see `struct fingerprint_s`. Needs O(N) extra memory, so it
+// works for matrices too large to copy
+//
+// Returns `true` if the tester passed
+bool run_tester_verify(const rotate_fn_t rotate_fn, const bits_t N) {
+  // Sanity check the input
+  assert(rotate_fn);
+  assert(N > 0);
+
+  // Checks whether `N` is a multiple of 64
+  assert(!(N % 64));
+
+  uint8_t *bit_matrix = generate_bit_matrix(N, false);
+  if (!bit_matrix) {
+    return false;
+  }
+
+  struct fingerprint_s fp;
+  if (!fingerprint_init(&fp, N, random_seed_from_clock())) {
+    printf("Error: Run out of heap space! Please try smaller matrix size.\n");
+    matrix_free(bit_matrix);
+    return false;
+  }
+
+  fasttime_t start = gettime();
+  fingerprint_input(&fp, bit_matrix);
+  const uint64_t input_msec = tdiff_msec(start, gettime());
+
+  // Call the user-defined `rotate_fn` and time it
+  const uint32_t user_msec = timed_eval(rotate_fn, bit_matrix, N);
+
+  struct fingerprint_mismatch_s mismatch;
+  start = gettime();
+  const bool result = fingerprint_check_rotated(&fp, bit_matrix, &mismatch);
+  const uint64_t check_msec = tdiff_msec(start, gettime());
+
+  if (!result) {
+    printf(FAIL_STR ": %" PRIu64 " rows and %" PRIu64
+                    " columns of the output are wrong",
+           mismatch.nrows, mismatch.ncols);
+    if (mismatch.nrows && mismatch.ncols) {
+      printf(", the first wrong row is j = %" PRIu64
+             " and column is i = %" PRIu64,
+             mismatch.first_row, mismatch.first_col);
+    }
+    printf("\n");
+  }
+
+  const uint64_t extra_bytes = N / 4 * 16 * sizeof(uint64_t) +
+                               (2 + 2 * parallel_nthreads()) * N *
+                                   sizeof(uint64_t);
+
+  // Clean up after ourselves!
+  fingerprint_free(&fp);
+  matrix_free(bit_matrix);
+
+  printf("Your time taken: %d ms\n", user_msec);
+  printf("Fingerprint time taken: %" PRIu64 " ms input, %" PRIu64
+         " ms output, %" PRIu64 " KiB extra memory instead of %" PRIu64
+         " KiB for a copy\n",
+         input_msec, check_msec, extra_bytes >> 10,
+         (uint64_t)(bits_to_bytes(N) * N) >> 10);
+
+  return result;
+}
+
 // Runs the tester on generated bit matrices of increasing sizes (tiers).
 // Tests the user supplied `rotate_fn` function against a working stock
 // rotation function. The tester doubles the dimension of the bit matrix
@@ -416,7 +839,7 @@ uint32_t run_tester_tiers(const rotate_fn_t rotate_fn,
 
 finish:
   // Clean up after ourselves!
-  free(bit_matrix);
+  matrix_free(bit_matrix);
 
   // Print update!
   if (highest_pass >= MAX_TIER + 1) {
@@ -436,15 +859,227 @@ finish:
   return highest_pass;
 }
 
+// Rotates generated bit matrices of growing dimension, from 64 up to `max_n`,
+// on a grid of about 2% steps, and prints the throughput at every point as
+// CSV. Does not check correctness.
+//
+// The detected cache and TLB sizes are marked where the matrix outgrows
+// them, and points whose throughput falls below 85% of the best so far are
+// flagged, which shows where the cliffs are
+void run_tester_sweep(const rotate_fn_t rotate_fn, const bits_t max_n) {
+  // Sanity check the input
+  assert(rotate_fn);
+  assert(max_n >= 64 && max_n % 64 == 0);
+
+  struct cache_info_s caches;
+  detect_caches(&caches);
+
+  const struct {
+    const char *name;
+    uint64_t size;
+  } boundaries[] = {
+      {"L1d", caches.l1d_size},
+      {"L2", caches.l2_size},
+      {"L3", caches.l3_size},
+      {caches.tlb_reach_assumed ? "TLB reach (assumed)" : "TLB reach",
+       caches.tlb_reach},
+  };
+  const int nboundaries = sizeof(boundaries) / sizeof(boundaries[0]);
+
+  printf("# L1d %" PRIu64 " KiB, L2 %" PRIu64 " KiB, L3 %" PRIu64
+         " KiB, TLB reach %" PRIu64 " KiB%s\n",
+         caches.l1d_size >> 10, caches.l2_size >> 10, caches.l3_size >> 10,
+         caches.tlb_reach >> 10, caches.tlb_reach_assumed ? " (assumed)" : "");
+
+  uint8_t *bit_matrix = generate_bit_matrix(max_n, true);
+  if (!bit_matrix) {
+    fprintf(stderr,
+            "Error: Run out of heap space! Please choose a smaller size\n");
+    assert(false);
+  }
+
+  printf("N,bytes,median_ns,ns_per_block,GB/s,note\n");
+
+  double best_gbps = 0;
+  uint64_t prev_bytes = 0;
+  for (bits_t N = 64; N <= max_n;) {
+    const uint64_t nbytes = (uint64_t)N * N / 8;
+
+    for (int b = 0; b < nboundaries; b++) {
+      if (boundaries[b].size && prev_bytes <= boundaries[b].size &&
+          nbytes > boundaries[b].size) {
+        printf("# matrix outgrows %s (%" PRIu64 " KiB)\n", boundaries[b].name,
+               boundaries[b].size >> 10);
+      }
+    }
+
+    struct timing_stats_s stats;
+    measure_rotation(rotate_fn, bit_matrix, N, &stats);
+
+    const double nblocks = (double)(N / 64) * (N / 64);
+    const double gbps = (double)nbytes / stats.median_ns;
+    const bool drop = gbps < 0.85 * best_gbps;
+    best_gbps = gbps > best_gbps ? gbps : best_gbps;
+
+    printf("%zu,%" PRIu64 ",%" PRIu64 ",%.1f,%.3f,%s\n", N, nbytes,
+           stats.median_ns,
+           stats.median_ns / nblocks, gbps, drop ? "drop" : "");
+
+    // Steps of 64 up to 6400, then steps of 2% rounded down to a multiple
+    // of 64
+    prev_bytes = nbytes;
+    N += N / 50 / 64 * 64 > 64 ? N / 50 / 64 * 64 : 64;
+  }
+
+  // Clean up after ourselves!
+  matrix_free(bit_matrix);
+}
+
+// The fixed cases of the benchmark suite: some tiers of the tier test, some
+// generated sizes and the sample images
+static const int SUITE_TIERS[] = {0, 5, 10};
+static const bits_t SUITE_SIZES[] = {1024, 4096, 16384};
+static const char *const SUITE_IMAGES[] = {"img/comic.bmp",
+                                           "img/speedlimit.bmp"};
+
+// Times one case of the benchmark suite and records it in `results`
+static void run_suite_case(const rotate_fn_t rotate_fn, uint8_t *const data,
+                           const bits_t N, const char *name,
+                           struct suite_results_s *results) {
+  struct timing_stats_s stats;
+  measure_rotation(rotate_fn, data, N, &stats);
+  suite_results_add(results, name, N, &stats);
+
+  printf("%s (N = %zu):\n", name, N);
+  print_timing_stats(&stats, N);
+}
+
+// Runs the fixed benchmark suite on `rotate_fn` with the timing options and
+// does not check correctness. The tiers start at `start_n` and grow by
+// `increasing_ratio_of_n` like in `run_tester_tiers`.
+//
+// The results are saved to `output_fname`, or to "bench-<git hash>.txt" if it
+// is NULL. If `baseline_fname` is not NULL, the results are compared against
+// the results saved there, see `suite_results_compare`.
+//
+// Returns `false` if a case regressed by more than the relative `threshold`
+// or there was an error
+bool run_tester_suite(const rotate_fn_t rotate_fn, const bits_t start_n,
+                      const double increasing_ratio_of_n,
+                      const char *const output_fname,
+                      const char *const baseline_fname,
+                      const double threshold) {
+  // Sanity check the input
+  assert(rotate_fn);
+  assert(start_n % 64 == 0);
+
+  struct suite_results_s results;
+  suite_results_init(&results);
+  printf("Benchmark suite: git %s on %s\n", results.git_hash, results.cpu);
+
+  // Every generated case rotates the top left of the one largest matrix
+  const int ntiers = sizeof(SUITE_TIERS) / sizeof(SUITE_TIERS[0]);
+  const int nsizes = sizeof(SUITE_SIZES) / sizeof(SUITE_SIZES[0]);
+  bits_t tier_sizes[sizeof(SUITE_TIERS) / sizeof(SUITE_TIERS[0])];
+  bits_t max_n = 0;
+
+  for (int t = 0; t < ntiers; t++) {
+    bits_t N = start_n;
+    for (int i = 0; i < SUITE_TIERS[t]; i++) {
+      N = (uint64_t)ceil(N * increasing_ratio_of_n / 64) * 64;
+    }
+    tier_sizes[t] = N;
+    max_n = N > max_n ? N : max_n;
+  }
+  for (int i = 0; i < nsizes; i++) {
+    max_n = SUITE_SIZES[i] > max_n ? SUITE_SIZES[i] : max_n;
+  }
+
+  uint8_t *bit_matrix = generate_bit_matrix(max_n, true);
+  if (!bit_matrix) {
+    fprintf(stderr,
+            "Error: Run out of heap space! Please choose smaller tier\n");
+    assert(false);
+  }
+
+  char name[SUITE_NAME_LENGTH];
+  for (int i = 0; i < nsizes; i++) {
+    run_suite_case(rotate_fn, bit_matrix, SUITE_SIZES[i], "generated",
+                   &results);
+  }
+  for (int t = 0; t < ntiers; t++) {
+    snprintf(name, sizeof(name), "tier%d", SUITE_TIERS[t]);
+    run_suite_case(rotate_fn, bit_matrix, tier_sizes[t], name, &results);
+  }
+
+  matrix_free(bit_matrix);
+
+  // The images are looked up relative to the working directory, and are
+  // skipped if they are not there
+  const int nimages = sizeof(SUITE_IMAGES) / sizeof(SUITE_IMAGES[0]);
+  for (int i = 0; i < nimages; i++) {
+    struct image_s image;
+    if (access(SUITE_IMAGES[i], R_OK) ||
+        !read_image(SUITE_IMAGES[i], &image)) {
+      printf(COLOR_YELLOW "Skipping %s: cannot read it" COLOR_DEFAULT "\n",
+             SUITE_IMAGES[i]);
+      continue;
+    }
+    assert(image.width == image.height);
+    assert(image.width % 64 == 0);
+
+    const char *base = strrchr(SUITE_IMAGES[i], '/');
+    snprintf(name, sizeof(name), "%s", base ? base + 1 : SUITE_IMAGES[i]);
+    run_suite_case(rotate_fn, image.data, image.width, name, &results);
+
+    free_image(&image);
+  }
+
+  char results_fname[128];
+  snprintf(results_fname, sizeof(results_fname), "%s",
+           output_fname ? output_fname : "");
+  if (!output_fname) {
+    snprintf(results_fname, sizeof(results_fname), "bench-%s.txt",
+             results.git_hash);
+  }
+  if (!suite_results_save(&results, results_fname)) {
+    return false;
+  }
+  printf("Saved results to %s\n", results_fname);
+
+  if (!baseline_fname) {
+    return true;
+  }
+
+  struct suite_results_s baseline;
+  if (!suite_results_load(&baseline, baseline_fname)) {
+    return false;
+  }
+
+  const uint32_t nregressions =
+      suite_results_compare(&baseline, &results, threshold);
+  if (nregressions) {
+    printf(FAIL_STR ": %u case%s regressed by more than %.0f%%\n",
+           nregressions, nregressions == 1 ? "" : "s", 100 * threshold);
+  } else {
+    printf(PASS_STR ": No regressions beyond %.0f%%\n", 100 * threshold);
+  }
+
+  return nregressions == 0;
+}
+
 // Runs the tester on generated bit matrices of increasing sizes (tiers).
 // Tests the user supplied `rotate_fn` function against a working stock
-// rotation function. The tester doubles the dimension of the bit matrix
-// until the `rotate_fn` cannot rotate it under (<) `timeout` ms
-// or returns an incorrect solution.
+// rotation function. The tester grows the dimension of the bit matrix
+// up to `max_n` or until the `rotate_fn` returns an incorrect solution.
 //
-// Returns the tier number that `rotate_fn` got to
+// Up to `BITWISE_CHECK_MAX_N` the stock rotation is itself checked against
+// the bit-at-a-time rotation.
+//
+// Returns `true` if the tester passed
 //
-bool run_correctness_tester(const rotate_fn_t rotate_fn, const bits_t start_n) {
+bool run_correctness_tester(const rotate_fn_t rotate_fn, const bits_t start_n,
+                            const bits_t max_n) {
   // Sanity check the input
   assert(rotate_fn);
   assert(start_n % 64 == 0);
@@ -457,20 +1092,33 @@ bool run_correctness_tester(const rotate_fn_t rotate_fn, const bits_t start_n) {
   bool correctness;
   const double SQRT_GOLDEN_RATIO = 1.2720196495141103;
 
+  // The matrices of every size reuse the same buffers, which are only
+  // mapped and faulted in once
+  matrix_pool_reserve(bits_to_bytes(max_n) * max_n, 2);
+
   // Be sure to increase the matrix dimension on every iteration
-  for (; N < 10000; N = (uint64_t)ceil(N * SQRT_GOLDEN_RATIO / 64) * 64) {
+  for (; N <= max_n; N = (uint64_t)ceil(N * SQRT_GOLDEN_RATIO / 64) * 64) {
     uint8_t *bit_matrix = generate_bit_matrix(N, false);
     uint8_t *bit_matrix_copy = copy_bit_matrix(bit_matrix, N);
-    const bytes_t row_size = bits_to_bytes(N);
-    const bytes_t bit_matrix_size = N * row_size;
+    uint8_t *bitwise_copy =
+        N <= BITWISE_CHECK_MAX_N ? copy_bit_matrix(bit_matrix, N) : NULL;
 
     for (uint32_t i = 0; i < 3; i++, tier++) {
       // Call the user-defined `rotate_fn` and time it
       const uint32_t user_msec = timed_eval(rotate_fn, bit_matrix, N);
 
       // Checking correctness - Call our stock rotation function on bit_matrix
-      _rotate_bit_matrix(bit_matrix_copy, N);
-      correctness = memcmp(bit_matrix, bit_matrix_copy, bit_matrix_size) == 0;
+      reference_rotate_bit_matrix(bit_matrix_copy, N);
+      if (bitwise_copy) {
+        bitwise_rotate_bit_matrix(bitwise_copy, N);
+        if (!matrix_equal(bitwise_copy, bit_matrix_copy,
+                          bits_to_bytes(N) * N, NULL)) {
+          fprintf(stderr, "Error: The stock rotation of a %zux%zu matrix is "
+                          "wrong\n", N, N);
+          assert(false);
+        }
+      }
+      correctness = check_rotation(bit_matrix_copy, bit_matrix, N);
 
       if (!correctness) {  // The rotation was not correct
         printf(FAIL_STR ": Test %d : Incorrectly rotated %zux%zu matrix\n",
@@ -484,8 +1132,358 @@ bool run_correctness_tester(const rotate_fn_t rotate_fn, const bits_t start_n) {
       print_test_pass_message(tier, N, user_msec);
     }
     // Clean up after ourselves!
-    free(bit_matrix);
-    free(bit_matrix_copy);
+    matrix_free(bit_matrix);
+    matrix_free(bit_matrix_copy);
+    matrix_free(bitwise_copy);
   }
   return true;
 }
+
+static const char *const BLOCK_OP_NAMES[] = {"none", "invert", "xor", "or",
+                                             "and"};
+
+// Checks rotate_bit_matrix_post() with every block op against the reference
+// rotation of `src` followed by the op applied bytewise, with `mask` as the
+// mask plane.
+//
+// Returns `true` if every op is right
+static bool check_block_ops(const uint8_t *const src, const uint8_t *const mask,
+                            const bits_t N) {
+  const bytes_t nbytes = bits_to_bytes(N) * N;
+  uint8_t *expected = matrix_alloc(nbytes);
+  uint8_t *actual = matrix_alloc(nbytes);
+  assert(expected && actual);
+  bool result = true;
+
+  for (int op = BLOCK_OP_NONE; op <= BLOCK_OP_AND && result; op++) {
+    matrix_copy(expected, src, nbytes);
+    reference_rotate_bit_matrix(expected, N);
+    for (bytes_t k = 0; k < nbytes; k++) {
+      switch (op) {
+        case BLOCK_OP_INVERT:
+          expected[k] = ~expected[k];
+          break;
+        case BLOCK_OP_XOR:
+          expected[k] ^= mask[k];
+          break;
+        case BLOCK_OP_OR:
+          expected[k] |= mask[k];
+          break;
+        case BLOCK_OP_AND:
+          expected[k] &= mask[k];
+          break;
+      }
+    }
+
+    const struct block_post_s post = {.op = op,
+                                      .mask = (const uint64_t *)mask};
+    matrix_copy(actual, src, nbytes);
+    rotate_bit_matrix_post(actual, N, &post);
+    result = check_rotation(expected, actual, N);
+    if (!result) {
+      printf(FAIL_STR ": block op %s of a %zux%zu matrix\n",
+             BLOCK_OP_NAMES[op], N, N);
+    }
+  }
+
+  matrix_free(expected);
+  matrix_free(actual);
+  return result;
+}
+
+// Checks the thumbnails of rotate_bit_matrix_thumbnails(), by OR and by
+// majority at every factor, against a count of the set bits of every cell of
+// the reference rotation of `src`.
+//
+// Returns `true` if every thumbnail is right
+static bool check_thumbnails(const uint8_t *const src, const bits_t N) {
+  const uint32_t factors[] = {2, 4, 8};
+  const enum downsample_mode_e modes[] = {DOWNSAMPLE_OR, DOWNSAMPLE_MAJORITY};
+  const uint32_t nthumbs = 6;
+  const bytes_t row_size = bits_to_bytes(N);
+
+  uint8_t *expected = copy_bit_matrix((uint8_t *)src, N);
+  uint8_t *actual = copy_bit_matrix((uint8_t *)src, N);
+  reference_rotate_bit_matrix(expected, N);
+
+  struct thumbnail_s thumbs[6];
+  for (uint32_t t = 0; t < nthumbs; t++) {
+    const uint32_t factor = factors[t / 2];
+    thumbs[t] = (struct thumbnail_s){
+        .factor = factor,
+        .mode = modes[t % 2],
+        .data = calloc(bits_to_bytes(N / factor) * (N / factor), 1),
+    };
+    assert(thumbs[t].data);
+  }
+  rotate_bit_matrix_thumbnails(actual, N, thumbs, nthumbs);
+
+  bool result = check_rotation(expected, actual, N);
+  for (uint32_t t = 0; t < nthumbs && result; t++) {
+    const uint32_t factor = thumbs[t].factor;
+    const bits_t n = N / factor;
+    const bytes_t thumb_row_size = bits_to_bytes(n);
+
+    for (uint32_t ty = 0; ty < n && result; ty++) {
+      for (uint32_t tx = 0; tx < n && result; tx++) {
+        uint32_t count = 0;
+        for (uint32_t y = ty * factor; y < (ty + 1) * factor; y++) {
+          for (uint32_t x = tx * factor; x < (tx + 1) * factor; x++) {
+            count += get_bit(expected, row_size, x, y);
+          }
+        }
+        const uint8_t want = thumbs[t].mode == DOWNSAMPLE_OR
+                                 ? count > 0
+                                 : 2 * count >= factor * factor;
+        const uint8_t got = get_bit(thumbs[t].data, thumb_row_size, tx, ty);
+        if (got != want) {
+          printf(FAIL_STR ": %s thumbnail by %u of a %zux%zu matrix, cell "
+                          "(%u, %u) is %u, %u of its bits are set\n",
+                 thumbs[t].mode == DOWNSAMPLE_OR ? "OR" : "majority", factor,
+                 N, N, tx, ty, got, count);
+          result = false;
+        }
+      }
+    }
+  }
+
+  for (uint32_t t = 0; t < nthumbs; t++) {
+    free(thumbs[t].data);
+  }
+  matrix_free(expected);
+  matrix_free(actual);
+  return result;
+}
+
+// The windows rotate_region() is checked on per matrix size
+#define REGION_CHECK_WINDOWS 12
+
+// Checks rotate_region() on windows of `src` at random offsets and of
+// random sizes, none of them multiples of 64 and some thinner than 64 bits,
+// against the reference rotation of `src` bit by bit, including the row
+// padding of the destination, which must be 0.
+//
+// Returns `true` if every window is right
+static bool check_regions(const uint8_t *const src, const bits_t N) {
+  const bytes_t row_size = bits_to_bytes(N);
+  uint8_t *expected = copy_bit_matrix((uint8_t *)src, N);
+  reference_rotate_bit_matrix(expected, N);
+
+  // A fixed sequence per size, so that a failure can be repeated
+  uint64_t state = N * 0x9E3779B97F4A7C15ULL + 1;
+  bool result = true;
+
+  for (uint32_t k = 0; k < REGION_CHECK_WINDOWS && result; k++) {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    const uint64_t r = state >> 16;
+
+    // Every fourth window is at most 63 bits wide, and every fourth from the
+    // second at most 63 bits tall
+    const uint32_t max_w = k % 4 == 0 && N > 64 ? 63 : N;
+    const uint32_t max_h = k % 4 == 1 && N > 64 ? 63 : N;
+    const uint32_t w = 1 + r % max_w;
+    const uint32_t h = 1 + (r >> 16) % max_h;
+    const uint32_t x = (r >> 32) % (N - w + 1);
+    const uint32_t y = (r >> 44) % (N - h + 1);
+
+    const bytes_t dst_row_size = rotate_region_row_size(h);
+    uint8_t *dst = matrix_alloc(dst_row_size * w);
+    assert(dst);
+    memset(dst, 0xFF, dst_row_size * w);
+    rotate_region(src, N, x, y, w, h, dst);
+
+    // The window lands at (N - y - h, x) in the rotated matrix
+    for (uint32_t row = 0; row < w && result; row++) {
+      for (uint32_t col = 0; col < dst_row_size * 8 && result; col++) {
+        const uint8_t want =
+            col < h ? get_bit(expected, row_size, N - y - h + col, x + row)
+                    : 0;
+        if (get_bit(dst, dst_row_size, col, row) != want) {
+          printf(FAIL_STR ": region of %ux%u at (%u, %u) of a %zux%zu "
+                          "matrix, wrong bit at (%u, %u)%s\n",
+                 w, h, x, y, N, N, col, row,
+                 col < h ? "" : " in the padding");
+          result = false;
+        }
+      }
+    }
+    matrix_free(dst);
+  }
+
+  matrix_free(expected);
+  return result;
+}
+
+// The single bits and the rectangles edited per round of the dirty tile check
+#define DIRTY_CHECK_BITS 7
+#define DIRTY_CHECK_RECTS 2
+#define DIRTY_CHECK_ROUNDS 3
+
+// Checks rotate_dirty_tiles(): starting from the rotation of `src`, edits a
+// few scattered bits with set_bit_tracked() and a few rectangles with
+// set_bit() and dirty_tiles_mark_rect(), re-rotates the dirty tiles and
+// compares the result with a full reference rotation, over a few rounds so
+// that the tracker is also checked to start clean after each one.
+//
+// Returns `true` if every round is right
+static bool check_dirty_tiles(const uint8_t *const src, const bits_t N) {
+  const bytes_t row_size = bits_to_bytes(N);
+  uint8_t *edited = copy_bit_matrix((uint8_t *)src, N);
+  uint8_t *rotated = copy_bit_matrix((uint8_t *)src, N);
+  reference_rotate_bit_matrix(rotated, N);
+
+  struct dirty_tiles_s dirty;
+  bool result = dirty_tiles_init(&dirty, N);
+  assert(result);
+
+  uint64_t state = N * 0xD1B54A32D192ED03ULL + 1;
+  for (uint32_t round = 0; round < DIRTY_CHECK_ROUNDS && result; round++) {
+    for (uint32_t k = 0; k < DIRTY_CHECK_BITS; k++) {
+      state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+      const uint32_t i = (state >> 16) % N, j = (state >> 40) % N;
+      set_bit_tracked(edited, row_size, i, j, !get_bit(edited, row_size, i, j),
+                      &dirty);
+    }
+    for (uint32_t k = 0; k < DIRTY_CHECK_RECTS; k++) {
+      state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+      const uint32_t w = 1 + (state >> 16) % 100 % N;
+      const uint32_t h = 1 + (state >> 24) % 100 % N;
+      const uint32_t x = (state >> 32) % (N - w + 1);
+      const uint32_t y = (state >> 48) % (N - h + 1);
+      for (uint32_t j = y; j < y + h; j++) {
+        for (uint32_t i = x; i < x + w; i++) {
+          set_bit(edited, row_size, i, j, (i ^ j ^ round) & 1);
+        }
+      }
+      dirty_tiles_mark_rect(&dirty, x, y, w, h);
+    }
+
+    rotate_dirty_tiles(edited, rotated, N, &dirty);
+
+    uint8_t *expected = copy_bit_matrix(edited, N);
+    reference_rotate_bit_matrix(expected, N);
+    result = check_rotation(expected, rotated, N);
+    matrix_free(expected);
+    if (!result) {
+      printf(FAIL_STR ": dirty tiles of a %zux%zu matrix, round %u\n", N, N,
+             round);
+    }
+
+    for (bytes_t word = 0; word < dirty.nwords && result; word++) {
+      if (dirty.bits[word]) {
+        printf(FAIL_STR ": dirty tiles of a %zux%zu matrix not cleared\n", N,
+               N);
+        result = false;
+      }
+    }
+  }
+
+  dirty_tiles_free(&dirty);
+  matrix_free(edited);
+  matrix_free(rotated);
+  return result;
+}
+
+// The budgets of the resumable rotation check, in blocks with no time limit,
+// then in nanoseconds with no block limit
+static const uint64_t STEP_CHECK_BLOCKS[] = {1, 3, 64};
+static const uint64_t STEP_CHECK_NS[] = {1, 20000};
+
+// Rotates a copy of `src` with rotate_step() and a `budget_ns` or
+// `budget_blocks` budget per step until it is done, checking that the
+// progress grows by at most a cycle past the block budget and never passes
+// the total, then compares the result with the reference rotation.
+//
+// Returns `true` if the rotation is right
+static bool check_step_budget(const uint8_t *const src,
+                              const uint8_t *const expected, const bits_t N,
+                              const uint64_t budget_ns,
+                              const uint64_t budget_blocks) {
+  uint8_t *actual = copy_bit_matrix((uint8_t *)src, N);
+  struct rotate_ctx_s *ctx = rotate_ctx_create();
+  assert(ctx);
+  rotate_begin(ctx, actual, N, NULL);
+
+  uint64_t total, steps = 0;
+  uint64_t progress = rotate_progress(ctx, &total);
+  enum rotate_status_e status = ROTATE_PENDING;
+  bool result = true;
+
+  while (status == ROTATE_PENDING && result) {
+    status = rotate_step(ctx, budget_ns, budget_blocks);
+    steps++;
+
+    const uint64_t next = rotate_progress(ctx, NULL);
+    const bool overrun = budget_blocks && next - progress >= budget_blocks + 4;
+    if (status == ROTATE_CANCELLED || next > total || overrun ||
+        (status == ROTATE_DONE) != (next == total)) {
+      printf(FAIL_STR ": step %" PRIu64 " of a %zux%zu matrix with budgets "
+                      "of %" PRIu64 " ns and %" PRIu64 " blocks, progress %"
+                      PRIu64 " to %" PRIu64 " of %" PRIu64 "\n",
+             steps, N, N, budget_ns, budget_blocks, progress, next, total);
+      result = false;
+    }
+    progress = next;
+  }
+
+  if (result && !check_rotation(expected, actual, N)) {
+    printf(FAIL_STR ": rotate_step() on a %zux%zu matrix with budgets of "
+                    "%" PRIu64 " ns and %" PRIu64 " blocks\n",
+           N, N, budget_ns, budget_blocks);
+    result = false;
+  }
+
+  rotate_ctx_destroy(ctx);
+  matrix_free(actual);
+  return result;
+}
+
+// Checks rotate_step() with small block and time budgets, so that the
+// rotation of `src` stops and resumes at many cycle boundaries.
+//
+// Returns `true` if every rotation is right
+static bool check_steps(const uint8_t *const src, const bits_t N) {
+  uint8_t *expected = copy_bit_matrix((uint8_t *)src, N);
+  reference_rotate_bit_matrix(expected, N);
+  const int nblock_budgets =
+      sizeof(STEP_CHECK_BLOCKS) / sizeof(STEP_CHECK_BLOCKS[0]);
+  const int nns_budgets = sizeof(STEP_CHECK_NS) / sizeof(STEP_CHECK_NS[0]);
+  bool result = true;
+
+  for (int k = 0; k < nblock_budgets && result; k++) {
+    result = check_step_budget(src, expected, N, 0, STEP_CHECK_BLOCKS[k]);
+  }
+  for (int k = 0; k < nns_budgets && result; k++) {
+    result = check_step_budget(src, expected, N, STEP_CHECK_NS[k], 0);
+  }
+
+  matrix_free(expected);
+  return result;
+}
+
+// Runs the checks of the library entry points besides the plain rotation on
+// generated bit matrices of increasing sizes up to `max_n`, including sizes
+// with an odd number of 64-bit blocks per row.
+//
+// Returns `true` if every check passed
+bool run_api_tester(const bits_t max_n) {
+  const double SQRT_GOLDEN_RATIO = 1.2720196495141103;
+  bool result = true;
+
+  for (bits_t N = 64; N <= max_n && result;
+       N = (uint64_t)ceil(N * SQRT_GOLDEN_RATIO / 64) * 64) {
+    uint8_t *src = generate_bit_matrix(N, false);
+    uint8_t *mask = generate_bit_matrix(N, false);
+
+    result = check_block_ops(src, mask, N) && check_thumbnails(src, N) &&
+             check_regions(src, N) && check_dirty_tiles(src, N) &&
+             check_steps(src, N);
+    if (result) {
+      printf(PASS_STR ": API checks of a %zux%zu matrix\n", N, N);
+    }
+
+    matrix_free(src);
+    matrix_free(mask);
+  }
+  return result;
+}
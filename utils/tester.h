@@ -23,6 +23,7 @@
 #ifndef TESTER_H
 #define TESTER_H
 
+#include "./perfcounters.h"
 #include "./utils.h"
 
 #define MAX_TIER 57
@@ -37,8 +38,33 @@
 
 typedef void (*rotate_fn_t)(uint8_t *, const bits_t);
 
+// Summary of the timed runs of one rotation, in nanoseconds. The cycle
+// fields are 0 unless TSC cycles were requested with `set_timing_options`.
+// `counts` holds the hardware counters summed over the timed runs, if any
+// were selected with `perf_counters_select`
+struct timing_stats_s {
+  uint32_t nsamples;
+  uint64_t min_ns;
+  uint64_t median_ns;
+  uint64_t p90_ns;
+  double mean_ns;
+  double stddev_ns;
+  uint64_t min_cycles;
+  uint64_t median_cycles;
+  uint64_t total_ns;
+  struct perf_counts_s counts;
+};
+
 void exitfunc(int sig);
 
+void set_timing_options(const uint32_t warmup, const uint32_t reps,
+                        const bool cycles);
+
+void measure_rotation(const rotate_fn_t rotate_fn, uint8_t *const data,
+                      const bits_t N, struct timing_stats_s *stats);
+
+void print_timing_stats(const struct timing_stats_s *stats, const bits_t N);
+
 bool run_tester(const char *const fname, const rotate_fn_t rotate_fn);
 
 bool run_tester_save_output(const char *fname, const char *const output_fname,
@@ -48,6 +74,8 @@ bool run_tester_save_output(const char *fname, const char *const output_fname,
 bool run_tester_generated_bit_matrix(const rotate_fn_t rotate_fn,
                                      const bits_t N);
 
+bool run_tester_verify(const rotate_fn_t rotate_fn, const bits_t N);
+
 uint32_t run_tester_tiers(const rotate_fn_t rotate_fn,
                           const uint32_t tier_timeout, const uint32_t timeout,
                           const bits_t start_n,
@@ -55,6 +83,17 @@ uint32_t run_tester_tiers(const rotate_fn_t rotate_fn,
                           const int start_tier, const int highest_tier,
                           const int linear_tiers, unsigned blowthroughs);
 
-bool run_correctness_tester(const rotate_fn_t rotate_fn, const bits_t start_n);
+void run_tester_sweep(const rotate_fn_t rotate_fn, const bits_t max_n);
+
+bool run_tester_suite(const rotate_fn_t rotate_fn, const bits_t start_n,
+                      const double increasing_ratio_of_n,
+                      const char *const output_fname,
+                      const char *const baseline_fname,
+                      const double threshold);
+
+bool run_correctness_tester(const rotate_fn_t rotate_fn, const bits_t start_n,
+                            const bits_t max_n);
+
+bool run_api_tester(const bits_t max_n);
 
 #endif  // TESTER_H
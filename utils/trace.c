@@ -0,0 +1,295 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#include "./trace.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./fasttime.h"
+
+// The events are recorded into a ring buffer per thread, so recording never
+// takes a lock or touches another thread's cache lines. When a ring is full
+// the oldest events are overwritten, and the number lost is exported.
+//
+// Spans are recorded once they end, with their start time, so a wrapped ring
+// never holds half of a begin/end pair.
+//
+// The workers of `parallel_for` are fresh threads on every call, so the ring
+// of a thread that exits is handed to the next thread that records, rather
+// than a new ring being allocated for every worker of every call
+
+#define TRACE_THREAD_NAME_LENGTH 32
+
+struct trace_event_s {
+  uint64_t start_ns;
+  uint64_t duration_ns;  // UINT64_MAX for instant events
+  const char *name;      // must outlive the trace, e.g. a string literal
+  uint64_t args[2];
+  enum trace_category_e category;
+};
+
+struct trace_buffer_s {
+  struct trace_buffer_s *next;
+  struct trace_buffer_s *next_retired;
+  uint32_t tid;
+  char name[TRACE_THREAD_NAME_LENGTH];
+
+  // The number of events ever recorded. Only the owning thread writes it
+  _Atomic uint64_t head;
+  struct trace_event_s events[];
+};
+
+static const char *const TRACE_CATEGORY_NAMES[TRACE_NCATEGORIES] = {
+    "tile", "steal", "io", "stage", "chunk"};
+
+static const char *const TRACE_ARG_NAMES[TRACE_NCATEGORIES][2] = {
+    {"h", "w"}, {"victim", "band"}, {"bytes", NULL}, {"N", NULL},
+    {"begin", "end"}};
+
+static bool trace_on = false;
+static uint64_t trace_capacity;
+static fasttime_t trace_epoch;
+
+// Every thread that recorded an event pushes its ring onto this list
+static _Atomic(struct trace_buffer_s *) trace_buffers = NULL;
+static atomic_uint trace_nthreads = 0;
+static _Thread_local struct trace_buffer_s *trace_self = NULL;
+
+// The rings of the threads that have exited, for reuse
+static pthread_mutex_t trace_retired_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_buffer_s *trace_retired = NULL;
+static pthread_key_t trace_self_key;
+static pthread_once_t trace_self_key_once = PTHREAD_ONCE_INIT;
+
+static void retire_buffer(void *arg) {
+  struct trace_buffer_s *buffer = arg;
+  pthread_mutex_lock(&trace_retired_lock);
+  buffer->next_retired = trace_retired;
+  trace_retired = buffer;
+  pthread_mutex_unlock(&trace_retired_lock);
+}
+
+static void create_self_key(void) {
+  pthread_key_create(&trace_self_key, retire_buffer);
+}
+
+// Turns on the recording of events, keeping the last `events_per_thread`
+// (rounded up to a power of 2) of every thread. Call it before any thread
+// records an event.
+//
+// Returns `false` if there was an error
+bool trace_enable(const uint32_t events_per_thread) {
+  if (!events_per_thread) {
+    return false;
+  }
+
+  trace_capacity = 1;
+  while (trace_capacity < events_per_thread) {
+    trace_capacity <<= 1;
+  }
+
+  trace_epoch = gettime();
+  trace_on = true;
+  return true;
+}
+
+bool trace_enabled(void) { return trace_on; }
+
+// Returns the trace clock, in ns since `trace_enable`
+uint64_t trace_now(void) { return tdiff_nsec(trace_epoch, gettime()); }
+
+// Returns the ring of the calling thread. On first use it takes the ring of
+// a thread that has exited, or allocates one. A ring that is taken over goes
+// back to its default name, so that the events of the new thread are not
+// shown under the name of the old one until it names itself
+static struct trace_buffer_s *trace_buffer(void) {
+  if (trace_self) {
+    return trace_self;
+  }
+
+  pthread_once(&trace_self_key_once, create_self_key);
+  pthread_mutex_lock(&trace_retired_lock);
+  struct trace_buffer_s *buffer = trace_retired;
+  if (buffer) {
+    trace_retired = buffer->next_retired;
+  }
+  pthread_mutex_unlock(&trace_retired_lock);
+  if (buffer) {
+    snprintf(buffer->name, sizeof(buffer->name), "thread %u", buffer->tid);
+    trace_self = buffer;
+    pthread_setspecific(trace_self_key, buffer);
+    return buffer;
+  }
+
+  buffer =
+      malloc(sizeof(*buffer) + trace_capacity * sizeof(struct trace_event_s));
+  if (!buffer) {
+    return NULL;
+  }
+
+  buffer->tid = atomic_fetch_add(&trace_nthreads, 1);
+  snprintf(buffer->name, sizeof(buffer->name), "thread %u", buffer->tid);
+  atomic_init(&buffer->head, 0);
+
+  buffer->next = atomic_load(&trace_buffers);
+  while (!atomic_compare_exchange_weak(&trace_buffers, &buffer->next, buffer)) {
+  }
+
+  trace_self = buffer;
+  pthread_setspecific(trace_self_key, buffer);
+  return buffer;
+}
+
+// Names the calling thread in the exported trace, e.g. "worker 3"
+void trace_set_thread_name(const char *name) {
+  if (!trace_on) {
+    return;
+  }
+
+  struct trace_buffer_s *buffer = trace_buffer();
+  if (buffer) {
+    snprintf(buffer->name, sizeof(buffer->name), "%s", name);
+  }
+}
+
+static void trace_record(const enum trace_category_e category,
+                         const char *name, const uint64_t start_ns,
+                         const uint64_t duration_ns, const uint64_t arg0,
+                         const uint64_t arg1) {
+  struct trace_buffer_s *buffer = trace_buffer();
+  if (!buffer) {
+    return;
+  }
+
+  const uint64_t head =
+      atomic_load_explicit(&buffer->head, memory_order_relaxed);
+  struct trace_event_s *event = &buffer->events[head & (trace_capacity - 1)];
+  event->start_ns = start_ns;
+  event->duration_ns = duration_ns;
+  event->name = name;
+  event->args[0] = arg0;
+  event->args[1] = arg1;
+  event->category = category;
+
+  // Publish the event to the exporting thread
+  atomic_store_explicit(&buffer->head, head + 1, memory_order_release);
+}
+
+// Records the span `name` from `start_ns`, taken with `trace_now`, until now.
+// Does nothing unless tracing is enabled
+void trace_span(const enum trace_category_e category, const char *name,
+                const uint64_t start_ns, const uint64_t arg0,
+                const uint64_t arg1) {
+  if (!trace_on) {
+    return;
+  }
+
+  const uint64_t now = trace_now();
+  trace_record(category, name, start_ns, now - start_ns, arg0, arg1);
+}
+
+// Records the instant event `name`, e.g. a steal. Does nothing unless tracing
+// is enabled
+void trace_instant(const enum trace_category_e category, const char *name,
+                   const uint64_t arg0, const uint64_t arg1) {
+  if (!trace_on) {
+    return;
+  }
+
+  trace_record(category, name, trace_now(), UINT64_MAX, arg0, arg1);
+}
+
+static void write_event_json(FILE *f, const struct trace_buffer_s *buffer,
+                             const struct trace_event_s *event) {
+  const char *const *arg_names = TRACE_ARG_NAMES[event->category];
+
+  fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"pid\":1,\"tid\":%u",
+          event->name, TRACE_CATEGORY_NAMES[event->category], buffer->tid);
+  if (event->duration_ns == UINT64_MAX) {
+    fprintf(f, ",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f",
+            event->start_ns / 1000.0);
+  } else {
+    fprintf(f, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f",
+            event->start_ns / 1000.0, event->duration_ns / 1000.0);
+  }
+
+  fprintf(f, ",\"args\":{\"%s\":%" PRIu64, arg_names[0], event->args[0]);
+  if (arg_names[1]) {
+    fprintf(f, ",\"%s\":%" PRIu64, arg_names[1], event->args[1]);
+  }
+  fprintf(f, "}}");
+}
+
+// Writes every recorded event to `fname` in the Chrome trace-event JSON
+// format, which Perfetto (ui.perfetto.dev) and chrome://tracing open
+// offline. Call it once the recording threads are done.
+//
+// Returns `false` if there was an error
+bool trace_write_json(const char *fname) {
+  FILE *f = fopen(fname, "w");
+
+  // There was some sort of error
+  if (!f) {
+    perror("Error writing trace file");
+    return false;
+  }
+
+  fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+             "\"args\":{\"name\":\"rotate\"}}");
+
+  uint64_t nevents = 0, ndropped = 0;
+  for (struct trace_buffer_s *buffer = atomic_load(&trace_buffers); buffer;
+       buffer = buffer->next) {
+    fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+               "\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+            buffer->tid, buffer->name);
+
+    const uint64_t head =
+        atomic_load_explicit(&buffer->head, memory_order_acquire);
+    const uint64_t first = head > trace_capacity ? head - trace_capacity : 0;
+    for (uint64_t e = first; e < head; e++) {
+      write_event_json(f, buffer,
+                       &buffer->events[e & (trace_capacity - 1)]);
+    }
+
+    nevents += head - first;
+    ndropped += first;
+  }
+
+  fprintf(f, "\n],\"metadata\":{\"dropped_events\":%" PRIu64 "}}\n",
+          ndropped);
+  fclose(f);
+
+  printf("Wrote %" PRIu64 " trace events to %s", nevents, fname);
+  if (ndropped) {
+    printf(" (%" PRIu64 " oldest events were overwritten)", ndropped);
+  }
+  printf("\n");
+  return true;
+}
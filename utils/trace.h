@@ -0,0 +1,59 @@
+/**
+ * Copyright (c) 2024 MIT License by 6.106 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Kinds of events on the rotation timeline. Each event carries up to two
+// integer arguments, named per category in the exported trace
+enum trace_category_e {
+  TRACE_TILE,   // an outer tile was rotated: h, w
+  TRACE_STEAL,  // a thread took a band of another node: victim, band
+  TRACE_IO,     // waiting on a file or the kernel: bytes
+  TRACE_STAGE,  // a stage of the test pipeline: N
+  TRACE_CHUNK,  // a chunk of a parallel loop, or a slice of an asynchronous
+                // rotation: begin, end
+  TRACE_NCATEGORIES
+};
+
+bool trace_enable(const uint32_t events_per_thread);
+
+bool trace_enabled(void);
+
+uint64_t trace_now(void);
+
+void trace_set_thread_name(const char *name);
+
+void trace_span(const enum trace_category_e category, const char *name,
+                const uint64_t start_ns, const uint64_t arg0,
+                const uint64_t arg1);
+
+void trace_instant(const enum trace_category_e category, const char *name,
+                   const uint64_t arg0, const uint64_t arg1);
+
+bool trace_write_json(const char *fname);
+
+#endif  // TRACE_H
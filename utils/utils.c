@@ -22,8 +22,16 @@
 
 #include "./utils.h"
 
+#include <stdatomic.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "./parallel.h"
+#include "./pool.h"
+
 // Calculates the number of bytes required to hold `nbits` bits
 inline bytes_t bits_to_bytes(bits_t nbits) { return (nbits + 7) / 8; }
 
@@ -41,7 +49,9 @@ uint8_t get_bit(uint8_t *img, const bytes_t row_size, uint32_t i, uint32_t j) {
 
 // Sets the bit at position (`i`, `j`) to `value`. The origin is the top left
 //
-// The `row_size` are the number of bytes per row in `img`
+// The `row_size` are the number of bytes per row in `img`. Writers of a
+// matrix that is re-rotated with rotate_dirty_tiles() use set_bit_tracked()
+// instead, which also marks the block of the bit dirty
 void set_bit(uint8_t *img, const bytes_t row_size, uint32_t i, uint32_t j,
              uint8_t value) {
   // Sanity check the input
@@ -83,6 +93,126 @@ void print_bit_matrix(uint8_t *bit_matrix, const bits_t N, int32_t ncolumns) {
   return;
 }
 
+// The generated bit matrices are a function of the seed and the profile
+static uint64_t generate_seed = 0;
+static enum generate_profile_e generate_profile = GENERATE_RANDOM;
+
+static const char *const GENERATE_PROFILE_NAMES[] = {"random", "sparse",
+                                                     "text"};
+
+// Sets the seed and the profile of every matrix from `generate_bit_matrix`.
+// The default is seed 0 and random bits
+void set_generate_options(const uint64_t seed,
+                          const enum generate_profile_e profile) {
+  generate_seed = seed;
+  generate_profile = profile;
+
+  // The tester draws from rand() too
+  srand(seed);
+}
+
+// Saves the profile called `name` in `profile`.
+//
+// Returns `false` if there is no such profile
+bool parse_generate_profile(const char *name,
+                            enum generate_profile_e *profile) {
+  const int nprofiles =
+      sizeof(GENERATE_PROFILE_NAMES) / sizeof(GENERATE_PROFILE_NAMES[0]);
+  for (int p = 0; p < nprofiles; p++) {
+    if (!strcmp(name, GENERATE_PROFILE_NAMES[p])) {
+      *profile = p;
+      return true;
+    }
+  }
+  return false;
+}
+
+// The SplitMix64 output function
+static inline uint64_t mix64(uint64_t z) {
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+  return z ^ (z >> 31);
+}
+
+// The `index`th output of the SplitMix64 stream of `seed`. It only depends on
+// the index, so any part of the stream can be generated on its own
+static inline uint64_t hash_index(const uint64_t seed, const uint64_t index) {
+  return mix64(seed + (index + 1) * 0x9E3779B97F4A7C15);
+}
+
+// Text is laid out in lines of 16 rows of glyphs and 8 blank rows. Every
+// glyph is 8 bits wide, and each of its rows is a single run of 2 to 4 set
+// bits or empty; about 1 in 8 glyphs is a space
+#define TEXT_LINE_ROWS 24
+#define TEXT_GLYPH_ROWS 16
+
+static inline uint8_t text_byte(const uint64_t seed, const bits_t N,
+                                const uint64_t y, const uint64_t x8) {
+  const uint64_t line = y / TEXT_LINE_ROWS, r = y % TEXT_LINE_ROWS;
+  const uint64_t glyph = line * (N / 8) + x8;
+  if (r >= TEXT_GLYPH_ROWS || !(hash_index(seed ^ 1, glyph) & 7)) {
+    return 0;
+  }
+
+  const uint64_t nibble = (hash_index(seed, glyph) >> (4 * r)) & 0xF;
+  if (nibble < 4) {
+    return 0;
+  }
+  const uint32_t start = nibble & 3, length = (nibble >> 2) + 1;
+  return (uint8_t)(0xFF00 >> length) >> start;
+}
+
+struct generate_job_s {
+  uint8_t *bit_matrix;
+  bits_t N;
+  uint64_t seed;
+  enum generate_profile_e profile;
+};
+
+// Fills the rows [`begin`, `end`) of the matrix. Every word or byte is a
+// function of its index only, so threads need not agree on anything
+static void generate_rows(const uint64_t begin, const uint64_t end,
+                          const uint32_t worker, void *arg) {
+  const struct generate_job_s *job = arg;
+  const bytes_t row_size = bits_to_bytes(job->N);
+  const uint64_t nwords = row_size / 8;
+  uint64_t *const words = (uint64_t *)job->bit_matrix;
+
+  switch (job->profile) {
+    case GENERATE_RANDOM:
+      for (uint64_t w = begin * nwords; w < end * nwords; w++) {
+        words[w] = hash_index(job->seed, w);
+      }
+      break;
+
+    case GENERATE_SPARSE: {
+      // 1 in 16 bits are set
+      const uint64_t seeds[4] = {mix64(job->seed), mix64(job->seed + 1),
+                                 mix64(job->seed + 2), mix64(job->seed + 3)};
+      for (uint64_t w = begin * nwords; w < end * nwords; w++) {
+        words[w] = hash_index(seeds[0], w) & hash_index(seeds[1], w) &
+                   hash_index(seeds[2], w) & hash_index(seeds[3], w);
+      }
+      break;
+    }
+
+    case GENERATE_TEXT:
+      for (uint64_t y = begin; y < end; y++) {
+        for (uint64_t x8 = 0; x8 < row_size; x8++) {
+          job->bit_matrix[y * row_size + x8] =
+              text_byte(job->seed, job->N, y, x8);
+        }
+      }
+      break;
+  }
+}
+
+// Allocates an `N` by `N` bit matrix and fills it according to the generate
+// options, see `set_generate_options`. The rows are filled in parallel, which
+// also places the pages on the NUMA nodes by mirrored bands of rows. The
+// matrix is from the buffer pool, and is freed with `matrix_free`.
+//
+// Returns NULL if it is out of memory
 uint8_t *generate_bit_matrix(const bits_t N, bool suppress_error) {
   // Sanity check the input
   assert(N > 0);
@@ -91,29 +221,29 @@ uint8_t *generate_bit_matrix(const bits_t N, bool suppress_error) {
   bytes_t nbytes = bits_to_bytes(N);
 
   uint8_t *ret;
-  ret = aligned_alloc(64, nbytes * N);
+  ret = matrix_alloc(nbytes * N);
   if (!ret) {
     if (!suppress_error)
       printf("Error: Run out of heap space! Please try smaller matrix size.\n");
     return NULL;
   }
 
-  uint64_t i;
-  uint64_t *pt = (uint64_t *)ret;
-
-  // seed the rand function with a random seed
-  srand(time(0));
-  uint64_t scrambled = (((uint64_t)rand()) << 32) | rand();
-  for (i = 0; i < (nbytes * N / 8); i++) {
-    *(pt + i) = scrambled;
-    scrambled = scrambled * (2 * scrambled + 1);
-    scrambled = scrambled * (2 * scrambled + 1);
-    scrambled = (scrambled << 32) | (scrambled >> 32);
-  }
+  struct generate_job_s job = {
+      .bit_matrix = ret,
+      .N = N,
+      .seed = generate_seed,
+      .profile = generate_profile,
+  };
+
+  // Chunks of about 256 KiB
+  const uint64_t rows_per_chunk = nbytes < (1 << 18) ? (1 << 18) / nbytes : 1;
+  parallel_for_placed(N, rows_per_chunk, NUMA_MIRRORED, generate_rows, &job);
 
   return ret;
 }
 
+// Copies `bit_matrix` into a matrix from the buffer pool, which is freed with
+// `matrix_free`
 uint8_t *copy_bit_matrix(uint8_t *bit_matrix, const bits_t N) {
   // Sanity check the input
   assert(N > 0);
@@ -122,14 +252,145 @@ uint8_t *copy_bit_matrix(uint8_t *bit_matrix, const bits_t N) {
   bytes_t nbytes = bits_to_bytes(N);
 
   uint8_t *ret;
-  ret = aligned_alloc(64, nbytes * N);
+  ret = matrix_alloc(nbytes * N);
   if (!ret) {
     printf("Error: Run out of heap space! Please try smaller matrix size.\n");
     assert(false);
   }
 
   // Copy the `bit_matrix`
-  memcpy(ret, bit_matrix, nbytes * N);
+  matrix_copy(ret, bit_matrix, nbytes * N);
 
   return ret;
 }
+
+// The copy and the compare split buffers into chunks of 1 MiB between threads
+#define MATRIX_CHUNK_SIZE (1 << 20)
+
+struct matrix_copy_s {
+  uint8_t *dst;
+  const uint8_t *src;
+  bytes_t nbytes;
+};
+
+static void copy_chunks(const uint64_t begin, const uint64_t end,
+                        const uint32_t worker, void *arg) {
+  const struct matrix_copy_s *copy = arg;
+  const bytes_t first = begin * MATRIX_CHUNK_SIZE;
+  const bytes_t last = end * MATRIX_CHUNK_SIZE < copy->nbytes
+                           ? end * MATRIX_CHUNK_SIZE
+                           : copy->nbytes;
+  uint8_t *dst = copy->dst + first;
+  const uint8_t *src = copy->src + first;
+  bytes_t n = last - first;
+
+#ifdef __SSE2__
+  // Copy up to the first 64-byte line of `dst` normally, then stream whole
+  // lines around the cache: the copy is not read again before the rotation
+  // under test has evicted it anyway
+  const bytes_t head = (64 - ((uintptr_t)dst & 63)) & 63;
+  if (head < n) {
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    n -= head;
+
+    for (; n >= 64; dst += 64, src += 64, n -= 64) {
+      const __m128i *s = (const __m128i *)src;
+      __m128i *d = (__m128i *)dst;
+      _mm_stream_si128(d, _mm_loadu_si128(s));
+      _mm_stream_si128(d + 1, _mm_loadu_si128(s + 1));
+      _mm_stream_si128(d + 2, _mm_loadu_si128(s + 2));
+      _mm_stream_si128(d + 3, _mm_loadu_si128(s + 3));
+    }
+    _mm_sfence();
+  }
+#endif
+
+  memcpy(dst, src, n);
+}
+
+// Copies `nbytes` from `src` to `dst` with all threads, each copying whole
+// chunks. When `dst` is freshly allocated, its pages are first touched by the
+// thread that copies them, which places them like `generate_bit_matrix` does
+void matrix_copy(uint8_t *dst, const uint8_t *src, const bytes_t nbytes) {
+  struct matrix_copy_s copy = {.dst = dst, .src = src, .nbytes = nbytes};
+  parallel_for_placed((nbytes + MATRIX_CHUNK_SIZE - 1) / MATRIX_CHUNK_SIZE, 1,
+                      NUMA_MIRRORED, copy_chunks, &copy);
+}
+
+struct matrix_compare_s {
+  const uint8_t *a;
+  const uint8_t *b;
+  bytes_t nbytes;
+
+  // The lowest offset found to differ so far, `nbytes` if none
+  _Atomic bytes_t first_diff;
+};
+
+static void compare_chunks(const uint64_t begin, const uint64_t end,
+                           const uint32_t worker, void *arg) {
+  struct matrix_compare_s *compare = arg;
+
+  for (uint64_t chunk = begin; chunk < end; chunk++) {
+    const bytes_t first = chunk * MATRIX_CHUNK_SIZE;
+
+    // Nothing past a known difference can be the first one
+    if (first >= atomic_load_explicit(&compare->first_diff,
+                                      memory_order_relaxed)) {
+      return;
+    }
+
+    const bytes_t n = first + MATRIX_CHUNK_SIZE < compare->nbytes
+                          ? MATRIX_CHUNK_SIZE
+                          : compare->nbytes - first;
+    if (!memcmp(compare->a + first, compare->b + first, n)) {
+      continue;
+    }
+
+    bytes_t diff = first;
+    while (compare->a[diff] == compare->b[diff]) {
+      diff++;
+    }
+
+    bytes_t known = atomic_load(&compare->first_diff);
+    while (diff < known &&
+           !atomic_compare_exchange_weak(&compare->first_diff, &known, diff)) {
+    }
+    return;
+  }
+}
+
+// Compares `nbytes` of `a` and `b` with all threads. Threads stop early once
+// a difference is found before their chunks. If `first_diff` is not NULL,
+// saves the offset of the first differing byte in it, or `nbytes` if there is
+// none.
+//
+// Returns `true` if they are equal
+bool matrix_equal(const uint8_t *a, const uint8_t *b, const bytes_t nbytes,
+                  bytes_t *first_diff) {
+  struct matrix_compare_s compare = {.a = a, .b = b, .nbytes = nbytes};
+  atomic_init(&compare.first_diff, nbytes);
+
+  parallel_for_placed((nbytes + MATRIX_CHUNK_SIZE - 1) / MATRIX_CHUNK_SIZE, 1,
+                      NUMA_MIRRORED, compare_chunks, &compare);
+
+  const bytes_t diff = atomic_load(&compare.first_diff);
+  if (first_diff) {
+    *first_diff = diff;
+  }
+  return diff == nbytes;
+}
+
+// Transposes the 8 by 8 bit tile `x`, whose row k is byte 7 - k (row 0 is the
+// most significant byte) with column 0 in the most significant bit of a row.
+// From Hacker's Delight, 7-3
+uint64_t transpose_tile_8(uint64_t x) {
+  x = (x & 0xAA55AA55AA55AA55) | ((x & 0x00AA00AA00AA00AA) << 7) |
+      ((x >> 7) & 0x00AA00AA00AA00AA);
+  x = (x & 0xCCCC3333CCCC3333) | ((x & 0x0000CCCC0000CCCC) << 14) |
+      ((x >> 14) & 0x0000CCCC0000CCCC);
+  x = (x & 0xF0F0F0F00F0F0F0F) | ((x & 0x00000000F0F0F0F0) << 28) |
+      ((x >> 28) & 0x00000000F0F0F0F0);
+  return x;
+}
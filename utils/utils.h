@@ -34,6 +34,13 @@
 typedef size_t bits_t;
 typedef size_t bytes_t;
 
+// What the generated bit matrices look like
+enum generate_profile_e {
+  GENERATE_RANDOM,  // uniformly random bits
+  GENERATE_SPARSE,  // 1 in 16 bits set at random
+  GENERATE_TEXT,    // lines of glyphs made of short horizontal runs
+};
+
 size_t bits_to_bytes(bits_t nbits);
 
 uint8_t get_bit(uint8_t *img, const bytes_t row_size, uint32_t i, uint32_t j);
@@ -43,8 +50,20 @@ void set_bit(uint8_t *img, const bytes_t row_size, uint32_t i, uint32_t j,
 
 void print_bit_matrix(uint8_t *bit_matrix, const bits_t N, int32_t subportion);
 
+void set_generate_options(const uint64_t seed,
+                          const enum generate_profile_e profile);
+
+bool parse_generate_profile(const char *name, enum generate_profile_e *profile);
+
 uint8_t *generate_bit_matrix(const bits_t N, bool suppress_error);
 
 uint8_t *copy_bit_matrix(uint8_t *bit_matrix, const bits_t N);
 
+void matrix_copy(uint8_t *dst, const uint8_t *src, const bytes_t nbytes);
+
+bool matrix_equal(const uint8_t *a, const uint8_t *b, const bytes_t nbytes,
+                  bytes_t *first_diff);
+
+uint64_t transpose_tile_8(uint64_t x);
+
 #endif  // UTILS_H